@@ -0,0 +1,24 @@
+#ifndef BENCH_H_
+
+#include "../lib/game.h"
+
+#include <time.h>
+
+// Shared by the standalone benchmarks, which are single translation units
+// built by make bench
+
+inline uint64_t bench_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Stands in for the platform's offscreen buffer
+inline offscreen_buffer bench_screen = {.width = WIDTH,
+                                        .height = HEIGHT,
+                                        .length = WIDTH * HEIGHT * BYTES_PER_PX,
+                                        .bytes_per_px = BYTES_PER_PX,
+                                        .buffer = {}};
+
+#define BENCH_H_
+#endif
@@ -0,0 +1,248 @@
+// Load time for BMP and TGA images, and blit throughput of the converted
+// bitmaps against drawing straight from the file bytes, which has to flip,
+// swizzle and premultiply every pixel on every draw. Build with make bench.
+
+#include "../lib/game.h"
+#include "bench.h"
+
+#include "../lib/game_bitmap.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What the unconverted draws go to, compared against bench_screen
+global_variable offscreen_buffer reference_screen = {
+    .width = WIDTH,
+    .height = HEIGHT,
+    .length = WIDTH * HEIGHT * BYTES_PER_PX,
+    .bytes_per_px = BYTES_PER_PX,
+    .buffer = {}};
+
+typedef struct test_file {
+  uint8_t *contents;
+  uint32_t size;
+  // Only used by the unconverted draw, which reads 32 bit bottom-up BGRA
+  uint32_t pixel_offset;
+} test_file_t;
+
+internal_fn void put_u16(uint8_t *at, uint16_t value) {
+  at[0] = value & 0xFF;
+  at[1] = value >> 8;
+}
+
+internal_fn void put_u32(uint8_t *at, uint32_t value) {
+  put_u16(at, value & 0xFFFF);
+  put_u16(at + 2, value >> 16);
+}
+
+// Straight alpha covering the whole range, including fully transparent and
+// fully opaque runs
+internal_fn void test_pixel(int32_t x, int32_t y, uint8_t *bgra) {
+  uint32_t noise = (x * 2654435761u) ^ (y * 40503u);
+  bgra[0] = (uint8_t)(noise >> 8);
+  bgra[1] = (uint8_t)(x * 3 + y);
+  bgra[2] = (uint8_t)(y * 5);
+  int32_t alpha = (x * 8) % 320 - 32;
+  bgra[3] = (uint8_t)(alpha < 0 ? 0 : alpha > 255 ? 255 : alpha);
+}
+
+// 32 bit BI_BITFIELDS with a V4 header, the usual way alpha BMPs are written
+internal_fn test_file_t make_bmp32(int32_t width, int32_t height) {
+  test_file_t file = {};
+  uint32_t header_size = 14 + 108;
+  file.pixel_offset = header_size;
+  file.size = header_size + width * height * 4;
+  file.contents = (uint8_t *)calloc(file.size, 1);
+
+  uint8_t *f = file.contents;
+  f[0] = 'B';
+  f[1] = 'M';
+  put_u32(f + 2, file.size);
+  put_u32(f + 10, file.pixel_offset);
+  put_u32(f + 14, 108);
+  put_u32(f + 18, width);
+  put_u32(f + 22, height);
+  put_u16(f + 26, 1);
+  put_u16(f + 28, 32);
+  put_u32(f + 30, 3);
+  put_u32(f + 54, 0x00FF0000);
+  put_u32(f + 58, 0x0000FF00);
+  put_u32(f + 62, 0x000000FF);
+  put_u32(f + 66, 0xFF000000);
+
+  for (int32_t y = 0; y < height; y++) {
+    uint8_t *row = f + file.pixel_offset + (height - 1 - y) * width * 4;
+    for (int32_t x = 0; x < width; x++) {
+      test_pixel(x, y, row + x * 4);
+    }
+  }
+  return file;
+}
+
+internal_fn test_file_t make_bmp24(int32_t width, int32_t height) {
+  test_file_t file = {};
+  uint32_t stride = (width * 3 + 3) & ~3;
+  file.pixel_offset = 54;
+  file.size = 54 + stride * height;
+  file.contents = (uint8_t *)calloc(file.size, 1);
+
+  uint8_t *f = file.contents;
+  f[0] = 'B';
+  f[1] = 'M';
+  put_u32(f + 2, file.size);
+  put_u32(f + 10, file.pixel_offset);
+  put_u32(f + 14, 40);
+  put_u32(f + 18, width);
+  put_u32(f + 22, height);
+  put_u16(f + 26, 1);
+  put_u16(f + 28, 24);
+
+  for (int32_t y = 0; y < height; y++) {
+    uint8_t *row = f + file.pixel_offset + (height - 1 - y) * stride;
+    for (int32_t x = 0; x < width; x++) {
+      uint8_t bgra[4];
+      test_pixel(x, y, bgra);
+      memcpy(row + x * 3, bgra, 3);
+    }
+  }
+  return file;
+}
+
+internal_fn test_file_t make_tga32(int32_t width, int32_t height) {
+  test_file_t file = {};
+  file.pixel_offset = 18;
+  file.size = 18 + width * height * 4;
+  file.contents = (uint8_t *)calloc(file.size, 1);
+
+  uint8_t *f = file.contents;
+  f[2] = 2;
+  put_u16(f + 12, width);
+  put_u16(f + 14, height);
+  f[16] = 32;
+  f[17] = 8;
+
+  for (int32_t y = 0; y < height; y++) {
+    uint8_t *row = f + file.pixel_offset + (height - 1 - y) * width * 4;
+    for (int32_t x = 0; x < width; x++) {
+      test_pixel(x, y, row + x * 4);
+    }
+  }
+  return file;
+}
+
+internal_fn void bench_load(const char *name, test_file_t *file,
+                            memory_arena_t *arena, uint32_t iterations) {
+  loaded_bitmap_t bitmap = {};
+  bool loaded = true;
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    arena->used = 0;
+    loaded &= bitmap_load(&bitmap, arena, file->contents, file->size);
+  }
+  uint64_t load_ns = bench_now_ns() - start;
+
+  double pixels = (double)bitmap.width * bitmap.height * iterations;
+  printf("  %-16s %4dx%-4d %8.3f ms/load, %7.1f Mpx/s, pitch %d%s\n", name,
+         bitmap.width, bitmap.height, load_ns / 1000000.0 / iterations,
+         pixels * 1000.0 / load_ns, bitmap.pitch,
+         loaded ? "" : " FAILED TO LOAD");
+}
+
+// What drawing looks like without the load step, every pixel is flipped,
+// swizzled and premultiplied each time it's drawn
+internal_fn void raw_bmp32_draw(offscreen_buffer *buff, test_file_t *file,
+                                int32_t width, int32_t height, int32_t x,
+                                int32_t y) {
+  int32_t dest_pitch = buff->width * buff->bytes_per_px;
+  for (int32_t row = 0; row < height; row++) {
+    uint8_t *source_px =
+        file->contents + file->pixel_offset + (height - 1 - row) * width * 4;
+    uint8_t *dest_px = buff->buffer + (y + row) * dest_pitch + x * 4;
+    for (int32_t column = 0; column < width; column++) {
+      uint32_t alpha = source_px[3];
+      uint8_t converted[4] = {
+          (uint8_t)alpha,
+          (uint8_t)bitmap_premultiply(source_px[0], alpha),
+          (uint8_t)bitmap_premultiply(source_px[1], alpha),
+          (uint8_t)bitmap_premultiply(source_px[2], alpha),
+      };
+      bitmap_blend_px(dest_px, converted);
+      source_px += 4;
+      dest_px += 4;
+    }
+  }
+}
+
+internal_fn void fill_screen(offscreen_buffer *buff) {
+  for (int i = 0; i < buff->length; i++) {
+    buff->buffer[i] = (uint8_t)(i * 7);
+  }
+}
+
+internal_fn void bench_blit(int32_t size, memory_arena_t *arena,
+                            uint32_t draws) {
+  test_file_t file = make_bmp32(size, size);
+  loaded_bitmap_t bitmap;
+  arena->used = 0;
+  bitmap_load(&bitmap, arena, file.contents, file.size);
+
+  // Positions are arbitrary so destination rows are mostly unaligned, as with
+  // a moving sprite
+  int32_t range_x = bench_screen.width - size;
+  int32_t range_y = bench_screen.height - size;
+
+  fill_screen(&bench_screen);
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < draws; i++) {
+    bitmap_draw(&bench_screen, &bitmap, (i * 7919u) % range_x,
+                (i * 104729u) % range_y);
+  }
+  uint64_t converted_ns = bench_now_ns() - start;
+
+  fill_screen(&reference_screen);
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < draws; i++) {
+    raw_bmp32_draw(&reference_screen, &file, size, size,
+                   (i * 7919u) % range_x, (i * 104729u) % range_y);
+  }
+  uint64_t raw_ns = bench_now_ns() - start;
+
+  bool match = memcmp(bench_screen.buffer, reference_screen.buffer,
+                      bench_screen.length) == 0;
+  double pixels = (double)size * size * draws;
+  printf("  %3dx%-3d converted %7.1f Mpx/s, unconverted %7.1f Mpx/s, "
+         "%.2fx%s\n",
+         size, size, pixels * 1000.0 / converted_ns, pixels * 1000.0 / raw_ns,
+         (double)raw_ns / converted_ns, match ? "" : ", OUTPUT DIFFERS");
+  free(file.contents);
+}
+
+int main() {
+  uint64_t arena_size = Megabytes(64);
+  void *arena_memory = malloc(arena_size);
+  memory_arena_t arena;
+  initialize_arena(&arena, arena_size, arena_memory);
+
+  printf("Load\n");
+  int32_t sizes[] = {64, 509, 2048};
+  for (uint32_t size_i = 0; size_i < array_length(sizes); size_i++) {
+    int32_t size = sizes[size_i];
+    uint32_t iterations = size <= 64 ? 20000 : size <= 512 ? 200 : 20;
+    test_file_t files[] = {make_bmp32(size, size), make_bmp24(size, size),
+                           make_tga32(size, size)};
+    const char *names[] = {"bmp 32 bitfield", "bmp 24", "tga 32"};
+    for (uint32_t file_i = 0; file_i < array_length(files); file_i++) {
+      bench_load(names[file_i], &files[file_i], &arena, iterations);
+      free(files[file_i].contents);
+    }
+  }
+
+  printf("Blit\n");
+  bench_blit(16, &arena, 400000);
+  bench_blit(64, &arena, 40000);
+  bench_blit(255, &arena, 2000);
+
+  free(arena_memory);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Compares the SoA entity store integration pass against an array of structs
+// baseline for 1k to 1M entities. Build with make bench.
+
+#include "../lib/game.h"
+#include "bench.h"
+
+#include "../lib/game_entity.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct aos_entity {
+  float position_x;
+  float position_y;
+  float velocity_x;
+  float velocity_y;
+  uint32_t flags;
+} aos_entity_t;
+
+internal_fn void aos_integrate(aos_entity_t *entities, uint32_t count,
+                               float delta_time) {
+  for (uint32_t i = 0; i < count; i++) {
+    entities[i].position_x += entities[i].velocity_x * delta_time;
+    entities[i].position_y += entities[i].velocity_y * delta_time;
+  }
+}
+
+int main() {
+  uint32_t counts[] = {1000, 10000, 100000, 1000000};
+  float delta_time = 1.0f / 60.0f;
+
+  printf("%10s %12s %12s %8s\n", "entities", "soa ns/ent", "aos ns/ent",
+         "speedup");
+
+  for (uint32_t count_i = 0; count_i < array_length(counts); count_i++) {
+    uint32_t count = counts[count_i];
+    // Keep the total work roughly even across sizes
+    int iterations = 200000000 / count;
+
+    uint64_t arena_size = Megabytes(64);
+    void *arena_memory = aligned_alloc(64, arena_size);
+    memory_arena_t arena;
+    initialize_arena(&arena, arena_size, arena_memory);
+
+    entity_store_t store;
+    if (!entity_store_init(&store, &arena, count)) {
+      printf("Arena too small for %u entities\n", count);
+      return 1;
+    }
+    aos_entity_t *aos = (aos_entity_t *)malloc(count * sizeof(aos_entity_t));
+
+    for (uint32_t i = 0; i < count; i++) {
+      float vx = (float)(rand() % 200 - 100);
+      float vy = (float)(rand() % 200 - 100);
+      entity_add(&store, 0.0f, 0.0f, vx, vy, ENTITY_FLAG_VISIBLE);
+      aos[i] = (aos_entity_t){0.0f, 0.0f, vx, vy, ENTITY_FLAG_VISIBLE};
+    }
+
+    uint64_t start = bench_now_ns();
+    for (int it = 0; it < iterations; it++) {
+      entity_integrate(&store, delta_time);
+    }
+    uint64_t soa_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (int it = 0; it < iterations; it++) {
+      aos_integrate(aos, count, delta_time);
+    }
+    uint64_t aos_ns = bench_now_ns() - start;
+
+    // Both should have moved the same way
+    if (store.position_x[count - 1] != aos[count - 1].position_x) {
+      printf("Mismatch at %u entities\n", count);
+      return 1;
+    }
+
+    double total = (double)count * iterations;
+    printf("%10u %12.3f %12.3f %7.2fx\n", count, soa_ns / total,
+           aos_ns / total, (double)aos_ns / soa_ns);
+
+    free(aos);
+    free(arena_memory);
+  }
+  return 0;
+}
@@ -0,0 +1,589 @@
+// Per-event cost of the platform's input dispatch, the real
+// PlatformHandleInputEvent from linux_input.cpp, against the chain of
+// comparisons it replaced, over synthetic keyboard and gamepad event streams.
+// Before timing, bindings.txt and a set of malformed lines are run through
+// PlatformParseInputBindings and a few events through the dispatcher, and the
+// bench fails if they don't come out as expected. Run from the repository
+// root or pass the bindings file as the first argument. Build with make
+// bench.
+
+#include "../lib/game.h"
+#include "bench.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Stand-ins for what linux_input.cpp takes from SDL, with SDL's values
+
+typedef uint8_t Uint8;
+typedef uint16_t Uint16;
+typedef uint32_t Uint32;
+typedef uint64_t Uint64;
+
+typedef enum SDL_Scancode {
+  SDL_SCANCODE_UNKNOWN = 0,
+  SDL_SCANCODE_A = 4,
+  SDL_SCANCODE_1 = 30,
+  SDL_SCANCODE_7 = 36,
+  SDL_SCANCODE_0 = 39,
+  SDL_SCANCODE_RETURN = 40,
+  SDL_SCANCODE_ESCAPE = 41,
+  SDL_SCANCODE_BACKSPACE = 42,
+  SDL_SCANCODE_TAB = 43,
+  SDL_SCANCODE_SPACE = 44,
+  SDL_SCANCODE_RIGHT = 79,
+  SDL_SCANCODE_LEFT = 80,
+  SDL_SCANCODE_DOWN = 81,
+  SDL_SCANCODE_UP = 82,
+  SDL_SCANCODE_LCTRL = 224,
+  SDL_SCANCODE_LSHIFT = 225,
+  SDL_SCANCODE_LALT = 226,
+  SDL_SCANCODE_LGUI = 227,
+  SDL_SCANCODE_RCTRL = 228,
+  SDL_SCANCODE_RSHIFT = 229,
+  SDL_SCANCODE_RALT = 230,
+  SDL_SCANCODE_RGUI = 231,
+  SDL_SCANCODE_COUNT = 512,
+} SDL_Scancode;
+
+#define SDL_SCANCODE_LETTER(c) (SDL_Scancode)(SDL_SCANCODE_A + (c) - 'A')
+#define SDLK_SCANCODE_MASK (1u << 30)
+#define SDLK_LETTER(c) (Uint32)((c) - 'A' + 'a')
+#define SDLK_ESCAPE 0x1Bu
+#define SDL_KMOD_ALT 0x0300u
+
+typedef enum SDL_GamepadButton {
+  SDL_GAMEPAD_BUTTON_INVALID = -1,
+  SDL_GAMEPAD_BUTTON_SOUTH,
+  SDL_GAMEPAD_BUTTON_EAST,
+  SDL_GAMEPAD_BUTTON_WEST,
+  SDL_GAMEPAD_BUTTON_NORTH,
+  SDL_GAMEPAD_BUTTON_BACK,
+  SDL_GAMEPAD_BUTTON_GUIDE,
+  SDL_GAMEPAD_BUTTON_START,
+  SDL_GAMEPAD_BUTTON_LEFT_STICK,
+  SDL_GAMEPAD_BUTTON_RIGHT_STICK,
+  SDL_GAMEPAD_BUTTON_LEFT_SHOULDER,
+  SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER,
+  SDL_GAMEPAD_BUTTON_DPAD_UP,
+  SDL_GAMEPAD_BUTTON_DPAD_DOWN,
+  SDL_GAMEPAD_BUTTON_DPAD_LEFT,
+  SDL_GAMEPAD_BUTTON_DPAD_RIGHT,
+  SDL_GAMEPAD_BUTTON_COUNT = 26,
+} SDL_GamepadButton;
+
+typedef enum SDL_GamepadAxis {
+  SDL_GAMEPAD_AXIS_INVALID = -1,
+  SDL_GAMEPAD_AXIS_LEFTX,
+  SDL_GAMEPAD_AXIS_LEFTY,
+  SDL_GAMEPAD_AXIS_RIGHTX,
+  SDL_GAMEPAD_AXIS_RIGHTY,
+  SDL_GAMEPAD_AXIS_LEFT_TRIGGER,
+  SDL_GAMEPAD_AXIS_RIGHT_TRIGGER,
+  SDL_GAMEPAD_AXIS_COUNT,
+} SDL_GamepadAxis;
+
+enum {
+  SDL_EVENT_KEY_DOWN = 0x300,
+  SDL_EVENT_KEY_UP,
+  SDL_EVENT_MOUSE_BUTTON_DOWN = 0x401,
+  SDL_EVENT_MOUSE_BUTTON_UP,
+  SDL_EVENT_GAMEPAD_AXIS_MOTION = 0x650,
+  SDL_EVENT_GAMEPAD_BUTTON_DOWN,
+  SDL_EVENT_GAMEPAD_BUTTON_UP,
+};
+
+#define SDL_BUTTON_LEFT 1
+#define SDL_BUTTON_RIGHT 3
+
+// The fields the dispatcher reads, padded to SDL's event size
+typedef union SDL_Event {
+  Uint32 type;
+  struct {
+    Uint32 type;
+    Uint8 button;
+    bool down;
+  } button;
+  struct {
+    Uint32 type;
+    SDL_Scancode scancode;
+    Uint32 key;
+    Uint16 mod;
+    bool down;
+    bool repeat;
+  } key;
+  struct {
+    Uint32 type;
+    Uint8 button;
+    bool down;
+  } gbutton;
+  struct {
+    Uint32 type;
+    Uint8 axis;
+    int16_t value;
+  } gaxis;
+  Uint8 padding[128];
+} SDL_Event;
+
+global_variable const char *bench_scancode_names[SDL_SCANCODE_COUNT];
+global_variable char bench_scancode_letters[26][2];
+global_variable char bench_scancode_digits[10][2];
+
+internal_fn void bench_init_scancode_names() {
+  for (int letter_i = 0; letter_i < 26; letter_i++) {
+    bench_scancode_letters[letter_i][0] = (char)('A' + letter_i);
+    bench_scancode_names[SDL_SCANCODE_A + letter_i] =
+        bench_scancode_letters[letter_i];
+  }
+  // 1 to 9 then 0, as on the keyboard
+  for (int digit_i = 0; digit_i < 10; digit_i++) {
+    bench_scancode_digits[digit_i][0] = (char)('0' + (digit_i + 1) % 10);
+    bench_scancode_names[SDL_SCANCODE_1 + digit_i] =
+        bench_scancode_digits[digit_i];
+  }
+  bench_scancode_names[SDL_SCANCODE_RETURN] = "Return";
+  bench_scancode_names[SDL_SCANCODE_ESCAPE] = "Escape";
+  bench_scancode_names[SDL_SCANCODE_BACKSPACE] = "Backspace";
+  bench_scancode_names[SDL_SCANCODE_TAB] = "Tab";
+  bench_scancode_names[SDL_SCANCODE_SPACE] = "Space";
+  bench_scancode_names[SDL_SCANCODE_RIGHT] = "Right";
+  bench_scancode_names[SDL_SCANCODE_LEFT] = "Left";
+  bench_scancode_names[SDL_SCANCODE_DOWN] = "Down";
+  bench_scancode_names[SDL_SCANCODE_UP] = "Up";
+  bench_scancode_names[SDL_SCANCODE_LCTRL] = "Left Ctrl";
+  bench_scancode_names[SDL_SCANCODE_LSHIFT] = "Left Shift";
+  bench_scancode_names[SDL_SCANCODE_LALT] = "Left Alt";
+  bench_scancode_names[SDL_SCANCODE_LGUI] = "Left GUI";
+  bench_scancode_names[SDL_SCANCODE_RCTRL] = "Right Ctrl";
+  bench_scancode_names[SDL_SCANCODE_RSHIFT] = "Right Shift";
+  bench_scancode_names[SDL_SCANCODE_RALT] = "Right Alt";
+  bench_scancode_names[SDL_SCANCODE_RGUI] = "Right GUI";
+}
+
+// Case insensitive like SDL's
+internal_fn SDL_Scancode SDL_GetScancodeFromName(const char *name) {
+  for (int scancode = 1; scancode < SDL_SCANCODE_COUNT; scancode++) {
+    const char *scancode_name = bench_scancode_names[scancode];
+    if (scancode_name && strcasecmp(scancode_name, name) == 0) {
+      return (SDL_Scancode)scancode;
+    }
+  }
+  return SDL_SCANCODE_UNKNOWN;
+}
+
+internal_fn SDL_GamepadButton SDL_GetGamepadButtonFromString(const char *str) {
+  const char *names[SDL_GAMEPAD_BUTTON_DPAD_RIGHT + 1] = {
+      "a",         "b",          "x",            "y",
+      "back",      "guide",      "start",        "leftstick",
+      "rightstick", "leftshoulder", "rightshoulder", "dpup",
+      "dpdown",    "dpleft",     "dpright"};
+  for (int button = 0; button <= SDL_GAMEPAD_BUTTON_DPAD_RIGHT; button++) {
+    if (strcasecmp(names[button], str) == 0) {
+      return (SDL_GamepadButton)button;
+    }
+  }
+  return SDL_GAMEPAD_BUTTON_INVALID;
+}
+
+internal_fn SDL_GamepadAxis SDL_GetGamepadAxisFromString(const char *str) {
+  const char *names[SDL_GAMEPAD_AXIS_COUNT] = {
+      "leftx", "lefty", "rightx", "righty", "lefttrigger", "righttrigger"};
+  for (int axis = 0; axis < SDL_GAMEPAD_AXIS_COUNT; axis++) {
+    if (strcasecmp(names[axis], str) == 0) {
+      return (SDL_GamepadAxis)axis;
+    }
+  }
+  return SDL_GAMEPAD_AXIS_INVALID;
+}
+
+internal_fn void SDL_GetMouseState(float *x, float *y) {
+  *x = 0;
+  *y = 0;
+}
+
+// Stand-ins for the platform, the log only counts so the parse check can see
+// how many lines were rejected
+global_variable bool quit;
+global_variable int left_stick_deadzone = 9000;
+global_variable int bench_log_count;
+
+internal_fn void PlatformLog(const char *format, ...) { bench_log_count++; }
+
+#include "../linux_input.cpp"
+
+// Parse check
+
+// Each bad line is rejected on its own and the good lines around it still
+// apply. The long one is cut off by the parser's line buffer.
+const char malformed_bindings[] =
+    "key\n"
+    "key W\n"
+    "key Left Shift\n"
+    "key Nonsense move_north\n"
+    "key W jump\n"
+    "button paddle9 start\n"
+    "axis leftx move_north\n"
+    "axis lefttrigger\n"
+    "pedal left move_north\n"
+    "key Right Shift right_shoulder_"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\n"
+    "# a comment\n"
+    "\n"
+    "\t key  Left Shift  left_shoulder # trailing comment\r\n"
+    "KEY w move_north\n"
+    "key w move_north\n"
+    "button START start\n"
+    "axis lefty move_y";
+const int malformed_bindings_bad_lines = 11;
+
+internal_fn bool bench_expect(bool ok, const char *what) {
+  if (!ok) {
+    printf("parse check failed: %s\n", what);
+  }
+  return ok;
+}
+
+internal_fn SDL_Event bench_key_event(SDL_Scancode scancode, Uint32 key,
+                                      bool down, bool repeat, Uint16 mod) {
+  SDL_Event event = {};
+  event.key.type = down ? SDL_EVENT_KEY_DOWN : SDL_EVENT_KEY_UP;
+  event.key.scancode = scancode;
+  event.key.key = key;
+  event.key.mod = mod;
+  event.key.down = down;
+  event.key.repeat = repeat;
+  return event;
+}
+
+internal_fn bool bench_parse_check(const char *bindings_path) {
+  FILE *file = fopen(bindings_path, "rb");
+  if (!file) {
+    printf("parse check failed: can't open %s\n", bindings_path);
+    return false;
+  }
+  Uint32 text_capacity = 1 << 16;
+  char *text = (char *)malloc(text_capacity);
+  Uint32 text_size = (Uint32)fread(text, 1, text_capacity, file);
+  fclose(file);
+
+  bool ok = true;
+  input_bindings_t shipped;
+  bench_log_count = 0;
+  PlatformParseInputBindings(text, text_size, bindings_path, &shipped);
+  free(text);
+  ok &= bench_expect(bench_log_count == 0, "bindings.txt has bad lines");
+
+  input_bindings_t defaults;
+  PlatformParseInputBindings(default_input_bindings,
+                             sizeof(default_input_bindings) - 1, "defaults",
+                             &defaults);
+  ok &= bench_expect(memcmp(&shipped, &defaults, sizeof(shipped)) == 0,
+                     "bindings.txt doesn't match the defaults");
+  ok &= bench_expect(shipped.keys[SDL_SCANCODE_LSHIFT] ==
+                         1u << INPUT_ACTION_LEFT_SHOULDER,
+                     "key Left Shift");
+  ok &= bench_expect(shipped.keys[SDL_SCANCODE_LCTRL] ==
+                         1u << INPUT_ACTION_RIGHT_SHOULDER,
+                     "key Left Ctrl");
+  ok &= bench_expect(shipped.keys[SDL_SCANCODE_0] ==
+                         1u << INPUT_ACTION_SAVE_SLOT_3,
+                     "key 0");
+  ok &= bench_expect(shipped.gamepad_buttons[SDL_GAMEPAD_BUTTON_START] ==
+                         ((1u << INPUT_ACTION_START) |
+                          (1u << INPUT_ACTION_QUIT)),
+                     "button start bound twice");
+  ok &= bench_expect(shipped.gamepad_axes[SDL_GAMEPAD_AXIS_LEFTY] ==
+                         INPUT_AXIS_MOVE_Y,
+                     "axis lefty");
+
+  input_bindings_t malformed;
+  bench_log_count = 0;
+  PlatformParseInputBindings(malformed_bindings,
+                             sizeof(malformed_bindings) - 1, "malformed",
+                             &malformed);
+  ok &= bench_expect(bench_log_count == malformed_bindings_bad_lines,
+                     "malformed lines rejected");
+  ok &= bench_expect(malformed.keys[SDL_SCANCODE_LSHIFT] ==
+                         1u << INPUT_ACTION_LEFT_SHOULDER,
+                     "tabs, spaces, comment and CR around Left Shift");
+  ok &= bench_expect(malformed.keys[SDL_SCANCODE_RSHIFT] == 0,
+                     "overlong line");
+  ok &= bench_expect(malformed.keys[SDL_SCANCODE_LETTER('W')] ==
+                         1u << INPUT_ACTION_MOVE_NORTH,
+                     "key w");
+  ok &= bench_expect(malformed.gamepad_buttons[SDL_GAMEPAD_BUTTON_START] ==
+                         1u << INPUT_ACTION_START,
+                     "button START");
+  ok &= bench_expect(malformed.gamepad_axes[SDL_GAMEPAD_AXIS_LEFTX] ==
+                         INPUT_AXIS_NONE,
+                     "axis bound to a button action");
+  ok &= bench_expect(malformed.gamepad_axes[SDL_GAMEPAD_AXIS_LEFTY] ==
+                         INPUT_AXIS_MOVE_Y,
+                     "last line without a newline");
+
+  // A few events through the dispatcher with the shipped bindings
+  input_bindings = shipped;
+  game_input_t inputs[2] = {};
+  SDL_Event event = bench_key_event(SDL_SCANCODE_LSHIFT,
+                                    SDLK_SCANCODE_MASK | SDL_SCANCODE_LSHIFT,
+                                    true, false, 0);
+  Uint32 hotkeys = PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(hotkeys == 0 &&
+                         inputs[0].controller.left_shoulder.ended_down &&
+                         inputs[0].controller.left_shoulder
+                                 .half_transition_count == 1,
+                     "Left Shift down");
+  event = bench_key_event(SDL_SCANCODE_7, '7', true, false, 0);
+  hotkeys = PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(hotkeys == 0, "7 without Alt");
+  event.key.mod = SDL_KMOD_ALT;
+  hotkeys = PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(hotkeys == 1u << INPUT_ACTION_SAVE_SLOT_0, "Alt 7");
+  event = bench_key_event(SDL_SCANCODE_LETTER('L'), SDLK_LETTER('L'), true,
+                          false, 0);
+  hotkeys = PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(hotkeys == 1u << INPUT_ACTION_TOGGLE_RECORDING, "L");
+  event.key.repeat = true;
+  hotkeys = PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(hotkeys == 0, "repeated L");
+  event = bench_key_event(SDL_SCANCODE_ESCAPE, SDLK_ESCAPE, true, true, 0);
+  PlatformHandleInputEvent(&event, &inputs[0], &inputs[1]);
+  ok &= bench_expect(quit, "repeated Escape");
+  quit = false;
+
+  printf("parse check %s\n", ok ? "ok" : "failed");
+  return ok;
+}
+
+// end Parse check
+
+internal_fn void handle_button(game_button_state_t *new_state, bool value) {
+  new_state->ended_down = value;
+  new_state->half_transition_count++;
+}
+
+internal_fn void handle_gamepad_button(game_button_state_t *old_state,
+                                       game_button_state_t *new_state,
+                                       bool value) {
+  new_state->ended_down = value;
+  new_state->half_transition_count +=
+      ((new_state->ended_down == old_state->ended_down) ? 0 : 1);
+}
+
+internal_fn float axis_value(int16_t value, int16_t deadzone) {
+  float result = 0;
+  if (value < -deadzone) {
+    result = (float)((value + deadzone) / (32768.0f - deadzone));
+  } else if (value > deadzone) {
+    result = (float)((value - deadzone) / (32767.0f - deadzone));
+  }
+  return result;
+}
+
+internal_fn void set_stick_buttons(controller_input_t *old_controller,
+                                   controller_input_t *new_controller) {
+  float threshold = 0.5f;
+  handle_gamepad_button(&old_controller->move_west, &new_controller->move_west,
+                        new_controller->left_stick_average_x < -threshold);
+  handle_gamepad_button(&old_controller->move_east, &new_controller->move_east,
+                        new_controller->left_stick_average_x > threshold);
+  handle_gamepad_button(&old_controller->move_north,
+                        &new_controller->move_north,
+                        new_controller->left_stick_average_y < -threshold);
+  handle_gamepad_button(&old_controller->move_south,
+                        &new_controller->move_south,
+                        new_controller->left_stick_average_y > threshold);
+}
+
+// The chain of keycode comparisons the platform had before the binding
+// tables, minus the dev hotkeys, kept here as the baseline
+internal_fn Uint32 chain_dispatch(SDL_Event *event, game_input_t *new_input,
+                                  game_input_t *old_input) {
+  controller_input_t *c = &new_input->controller;
+  if (event->type == SDL_EVENT_KEY_DOWN || event->type == SDL_EVENT_KEY_UP) {
+    Uint32 key = event->key.key;
+    bool down = event->key.down;
+    if (key == SDLK_ESCAPE) {
+      quit = true;
+    }
+    if (event->key.repeat == 0) {
+      // clang-format off
+      if (key == SDLK_LETTER('W')) { c->is_analog = false; handle_button(&c->move_north, down); }
+      if (key == SDLK_LETTER('A')) { c->is_analog = false; handle_button(&c->move_west, down); }
+      if (key == SDLK_LETTER('S')) { c->is_analog = false; handle_button(&c->move_south, down); }
+      if (key == SDLK_LETTER('D')) { c->is_analog = false; handle_button(&c->move_east, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_UP)) { c->is_analog = false; handle_button(&c->move_north, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_LEFT)) { c->is_analog = false; handle_button(&c->move_west, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_DOWN)) { c->is_analog = false; handle_button(&c->move_south, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_RIGHT)) { c->is_analog = false; handle_button(&c->move_east, down); }
+      if (key == SDLK_LETTER('E')) { handle_button(&c->action_south, down); }
+      if (key == SDLK_LETTER('F')) { handle_button(&c->action_east, down); }
+      if (key == SDLK_LETTER('Q')) { handle_button(&c->action_west, down); }
+      if (key == SDLK_LETTER('R')) { handle_button(&c->action_north, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_LSHIFT)) { handle_button(&c->left_shoulder, down); }
+      if (key == (SDLK_SCANCODE_MASK | SDL_SCANCODE_LCTRL)) { handle_button(&c->right_shoulder, down); }
+      if (key == SDLK_LETTER('P')) { handle_button(&c->start, down); }
+      if (key == SDLK_LETTER('I')) { handle_button(&c->select, down); }
+      // clang-format on
+    }
+  }
+
+  if (event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+    if (event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTX ||
+        event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTY) {
+      c->is_analog = true;
+      c->left_stick_average_x =
+          axis_value(event->gaxis.value, left_stick_deadzone);
+      c->left_stick_average_y =
+          axis_value(event->gaxis.value, left_stick_deadzone);
+      set_stick_buttons(&old_input->controller, c);
+    }
+  }
+
+  if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN ||
+      event->type == SDL_EVENT_GAMEPAD_BUTTON_UP) {
+    Uint8 button = event->gbutton.button;
+    bool down = event->gbutton.down;
+    // clang-format off
+    if (button == SDL_GAMEPAD_BUTTON_START) { handle_button(&c->start, down); quit = true; }
+    if (button == SDL_GAMEPAD_BUTTON_BACK) { handle_button(&c->select, down); }
+    if (button == SDL_GAMEPAD_BUTTON_LEFT_SHOULDER) { handle_button(&c->left_shoulder, down); }
+    if (button == SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER) { handle_button(&c->right_shoulder, down); }
+    if (button == SDL_GAMEPAD_BUTTON_WEST) { handle_button(&c->action_west, down); }
+    if (button == SDL_GAMEPAD_BUTTON_NORTH) { handle_button(&c->action_north, down); }
+    if (button == SDL_GAMEPAD_BUTTON_SOUTH) { handle_button(&c->action_south, down); }
+    if (button == SDL_GAMEPAD_BUTTON_EAST) { handle_button(&c->action_east, down); }
+    if (button == SDL_GAMEPAD_BUTTON_DPAD_UP) { c->is_analog = false; handle_button(&c->move_north, down); }
+    if (button == SDL_GAMEPAD_BUTTON_DPAD_DOWN) { c->is_analog = false; handle_button(&c->move_south, down); }
+    if (button == SDL_GAMEPAD_BUTTON_DPAD_LEFT) { c->is_analog = false; handle_button(&c->move_west, down); }
+    if (button == SDL_GAMEPAD_BUTTON_DPAD_RIGHT) { c->is_analog = false; handle_button(&c->move_east, down); }
+    // clang-format on
+  }
+  return 0;
+}
+
+typedef Uint32 dispatch_t(SDL_Event *event, game_input_t *new_input,
+                          game_input_t *old_input);
+
+// Input is reset every 64 events, about what arrives in a busy frame
+internal_fn double run_stream(dispatch_t *dispatch, SDL_Event *events,
+                              uint32_t event_count, uint32_t passes,
+                              uint32_t *checksum) {
+  game_input_t inputs[2] = {};
+  uint64_t start = bench_now_ns();
+  for (uint32_t pass = 0; pass < passes; pass++) {
+    for (uint32_t i = 0; i < event_count; i++) {
+      if ((i & 63) == 0) {
+        inputs[1] = inputs[0];
+        inputs[0] = {};
+      }
+      *checksum += dispatch(&events[i], &inputs[0], &inputs[1]);
+    }
+  }
+  uint64_t elapsed_ns = bench_now_ns() - start;
+  for (int button_i = 0; button_i < 12; button_i++) {
+    *checksum += inputs[0].controller.buttons[button_i].half_transition_count;
+  }
+  return (double)elapsed_ns / ((double)event_count * passes);
+}
+
+internal_fn void run_both(const char *name, SDL_Event *events,
+                          uint32_t event_count, uint32_t passes,
+                          uint32_t *checksum) {
+  double chain_ns =
+      run_stream(chain_dispatch, events, event_count, passes, checksum);
+  double table_ns = run_stream(PlatformHandleInputEvent, events, event_count,
+                               passes, checksum);
+  printf("%-13s %8.2f %8.2f\n", name, chain_ns, table_ns);
+}
+
+int main(int argc, char **argv) {
+  bench_init_scancode_names();
+  if (!bench_parse_check(argc > 1 ? argv[1] : "bindings.txt")) {
+    return 1;
+  }
+  PlatformParseInputBindings(default_input_bindings,
+                             sizeof(default_input_bindings) - 1, "defaults",
+                             &input_bindings);
+
+  uint32_t event_count = 1 << 16;
+  uint32_t passes = 200;
+  SDL_Event *events = (SDL_Event *)malloc(event_count * sizeof(SDL_Event));
+
+  struct {
+    SDL_Scancode scancode;
+    Uint32 key;
+  } bound_keys[] = {
+      {SDL_SCANCODE_LETTER('W'), SDLK_LETTER('W')},
+      {SDL_SCANCODE_LETTER('A'), SDLK_LETTER('A')},
+      {SDL_SCANCODE_LETTER('S'), SDLK_LETTER('S')},
+      {SDL_SCANCODE_LETTER('D'), SDLK_LETTER('D')},
+      {SDL_SCANCODE_UP, SDLK_SCANCODE_MASK | SDL_SCANCODE_UP},
+      {SDL_SCANCODE_RIGHT, SDLK_SCANCODE_MASK | SDL_SCANCODE_RIGHT},
+      {SDL_SCANCODE_LETTER('E'), SDLK_LETTER('E')},
+      {SDL_SCANCODE_LETTER('R'), SDLK_LETTER('R')},
+      {SDL_SCANCODE_LSHIFT, SDLK_SCANCODE_MASK | SDL_SCANCODE_LSHIFT},
+      {SDL_SCANCODE_LETTER('I'), SDLK_LETTER('I')},
+  };
+
+  srand(11);
+  uint32_t checksum = 0;
+  printf("ns per event     chain    table\n");
+
+  // Bound keys in random order, as while playing
+  for (uint32_t i = 0; i < event_count; i++) {
+    uint32_t key_i = rand() % array_length(bound_keys);
+    events[i] = bench_key_event(bound_keys[key_i].scancode,
+                                bound_keys[key_i].key, i & 1,
+                                (i % 16) == 15, 0);
+  }
+  run_both("bound keys", events, event_count, passes, &checksum);
+
+  // Keys nothing is bound to, typing in another window's shortcut or
+  // a held modifier, which walk the whole chain
+  for (uint32_t i = 0; i < event_count; i++) {
+    char letter = "BCGHJMNOTUVXYZ"[rand() % 14];
+    events[i] = bench_key_event(SDL_SCANCODE_LETTER(letter),
+                                SDLK_LETTER(letter), i & 1, (i % 16) == 15, 0);
+  }
+  run_both("unbound keys", events, event_count, passes, &checksum);
+
+  // Gamepad, mostly stick motion with face and dpad buttons mixed in
+  Uint8 gamepad_buttons[] = {
+      SDL_GAMEPAD_BUTTON_SOUTH,     SDL_GAMEPAD_BUTTON_EAST,
+      SDL_GAMEPAD_BUTTON_WEST,      SDL_GAMEPAD_BUTTON_NORTH,
+      SDL_GAMEPAD_BUTTON_DPAD_UP,   SDL_GAMEPAD_BUTTON_DPAD_DOWN,
+      SDL_GAMEPAD_BUTTON_DPAD_LEFT, SDL_GAMEPAD_BUTTON_DPAD_RIGHT,
+      SDL_GAMEPAD_BUTTON_LEFT_SHOULDER};
+  for (uint32_t i = 0; i < event_count; i++) {
+    SDL_Event event = {};
+    if (rand() % 4) {
+      event.gaxis.type = SDL_EVENT_GAMEPAD_AXIS_MOTION;
+      event.gaxis.axis =
+          rand() % 2 ? SDL_GAMEPAD_AXIS_LEFTX : SDL_GAMEPAD_AXIS_LEFTY;
+      event.gaxis.value = (int16_t)(rand() % 65536 - 32768);
+    } else {
+      event.gbutton.type = (i & 1) ? SDL_EVENT_GAMEPAD_BUTTON_DOWN
+                                   : SDL_EVENT_GAMEPAD_BUTTON_UP;
+      event.gbutton.button =
+          gamepad_buttons[rand() % array_length(gamepad_buttons)];
+      event.gbutton.down = i & 1;
+    }
+    events[i] = event;
+  }
+  run_both("gamepad", events, event_count, passes, &checksum);
+
+  // Keeps the work from being optimised out
+  if (checksum == 0 || quit) {
+    printf("checksum %u\n", checksum);
+  }
+
+  free(events);
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Lookup, iteration and memory figures for the chunked tile map on a sparse
+// and a dense world, with a flat array as the dense baseline. Build with
+// make bench.
+
+#include "../lib/game.h"
+#include "bench.h"
+
+#include "../lib/game_tile.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct tile_coord {
+  int32_t x;
+  int32_t y;
+} tile_coord_t;
+
+internal_fn void bench_world(const char *name, tile_coord_t *coords,
+                             uint32_t coord_count, uint32_t hash_capacity,
+                             int32_t extent) {
+  uint64_t arena_size = Megabytes(256);
+  void *arena_memory = malloc(arena_size);
+  memory_arena_t arena;
+  initialize_arena(&arena, arena_size, arena_memory);
+
+  tile_map_t map;
+  tile_map_init(&map, &arena, hash_capacity);
+
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < coord_count; i++) {
+    tile_map_set(&map, coords[i].x, coords[i].y, 1 + (i & 0x7F));
+  }
+  uint64_t set_ns = bench_now_ns() - start;
+
+  // Random order defeats the cached chunk so this is the hash path
+  uint32_t lookups = 4000000;
+  uint32_t found = 0;
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < lookups; i++) {
+    tile_coord_t c = coords[(i * 2654435761u) % coord_count];
+    found += tile_map_get(&map, c.x, c.y) != TILE_EMPTY;
+  }
+  uint64_t random_ns = bench_now_ns() - start;
+
+  // A scan across rows mostly stays in the cached chunk or steps east
+  uint32_t scanned = 0;
+  start = bench_now_ns();
+  for (int32_t y = -64; y < 64; y++) {
+    for (int32_t x = -extent / 2; x < extent / 2; x++) {
+      found += tile_map_get(&map, x, y) != TILE_EMPTY;
+      scanned++;
+    }
+  }
+  uint64_t scan_ns = bench_now_ns() - start;
+
+  // The camera is centred on a written tile each frame, so in the sparse
+  // world it looks at an island rather than empty space
+  uint32_t frames = 100000;
+  uint32_t visible = 0;
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < frames; i++) {
+    tile_coord_t c = coords[(i * 2654435761u) % coord_count];
+    int32_t camera_x = c.x * TILE_SIZE_PX - bench_screen.width / 2;
+    int32_t camera_y = c.y * TILE_SIZE_PX - bench_screen.height / 2;
+    tile_chunk_iterator_t it =
+        tile_map_visible_chunks(&map, camera_x, camera_y, &bench_screen);
+    while (tile_map_next_visible_chunk(&it)) {
+      visible++;
+    }
+  }
+  uint64_t visible_ns = bench_now_ns() - start;
+
+  uint64_t flat_bytes = (uint64_t)extent * extent;
+  printf("%s world: %u tiles written in %u chunks\n", name, coord_count,
+         map.chunk_count);
+  printf("  set          %8.2f ns/tile\n", (double)set_ns / coord_count);
+  printf("  random get   %8.2f ns\n", (double)random_ns / lookups);
+  printf("  scan get     %8.2f ns\n", (double)scan_ns / scanned);
+  printf("  visible      %8.2f us/frame, %.1f chunks/frame\n",
+         visible_ns / 1000.0 / frames, (double)visible / frames);
+  printf("  memory       %8.2f MB, flat array would be %.2f MB\n",
+         arena.used / (1024.0 * 1024.0), flat_bytes / (1024.0 * 1024.0));
+
+  if (found == 0) {
+    printf("  nothing found\n");
+  }
+  free(arena_memory);
+}
+
+internal_fn void bench_flat(tile_coord_t *coords, uint32_t coord_count,
+                            int32_t extent) {
+  uint8_t *flat = (uint8_t *)calloc((uint64_t)extent * extent, 1);
+  int32_t half = extent / 2;
+  for (uint32_t i = 0; i < coord_count; i++) {
+    flat[(uint64_t)(coords[i].y + half) * extent + coords[i].x + half] =
+        1 + (i & 0x7F);
+  }
+
+  uint32_t lookups = 4000000;
+  uint32_t found = 0;
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < lookups; i++) {
+    tile_coord_t c = coords[(i * 2654435761u) % coord_count];
+    found += flat[(uint64_t)(c.y + half) * extent + c.x + half] != TILE_EMPTY;
+  }
+  uint64_t random_ns = bench_now_ns() - start;
+  printf("  flat random get %5.2f ns (%u found)\n",
+         (double)random_ns / lookups, found);
+  free(flat);
+}
+
+int main() {
+  // Dense, every tile of a 1024x1024 area
+  int32_t dense_extent = 1024;
+  uint32_t dense_count = dense_extent * dense_extent;
+  tile_coord_t *dense =
+      (tile_coord_t *)malloc(dense_count * sizeof(tile_coord_t));
+  for (uint32_t i = 0; i < dense_count; i++) {
+    dense[i].x = (int32_t)(i % dense_extent) - dense_extent / 2;
+    dense[i].y = (int32_t)(i / dense_extent) - dense_extent / 2;
+  }
+  bench_world("Dense", dense, dense_count, 16384, dense_extent);
+  bench_flat(dense, dense_count, dense_extent);
+
+  // Sparse, small islands scattered over a 65536x65536 area
+  int32_t sparse_extent = 65536;
+  uint32_t sparse_count = 0;
+  uint32_t island_count = 2000;
+  tile_coord_t *sparse =
+      (tile_coord_t *)malloc(island_count * 64 * sizeof(tile_coord_t));
+  srand(7);
+  for (uint32_t island = 0; island < island_count; island++) {
+    int32_t x = rand() % sparse_extent - sparse_extent / 2;
+    int32_t y = rand() % sparse_extent - sparse_extent / 2;
+    for (int32_t i = 0; i < 64; i++) {
+      sparse[sparse_count].x = x + i % 8;
+      sparse[sparse_count].y = y + i / 8;
+      sparse_count++;
+    }
+  }
+  bench_world("Sparse", sparse, sparse_count, 16384, sparse_extent);
+
+  free(dense);
+  free(sparse);
+  return 0;
+}
@@ -0,0 +1,144 @@
+// Scaling of the platform work queue from WORKER_THREADS=0 up to one worker
+// per core, over the game's own frame and over a compute bound pass split
+// the same way. The queue's workers live as long as the process, so each
+// worker count runs in a child process. Pass the highest worker count to
+// try as the first argument, by default it is the number of cores the
+// process may run on. Build with make bench.
+
+#include "../lib/game.h"
+#include "bench.h"
+
+#include "../lib/game.cpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Stand-ins for what the work queue takes from SDL and the platform
+typedef uint32_t Uint32;
+typedef uint64_t Uint64;
+typedef int64_t Sint64;
+#define SDL_clamp(x, a, b) ((x) < (a) ? (a) : (x) > (b) ? (b) : (x))
+
+internal_fn void PlatformLog(const char *format, ...) {}
+
+#include "../linux_work_queue.cpp"
+
+#define BENCH_FRAMES 3000
+#define BENCH_SHADE_PASSES 60
+#define BENCH_SHADE_ROUNDS 48
+
+typedef struct bench_result {
+  int worker_count;
+  double frame_ms;
+  double shade_ms;
+} bench_result_t;
+
+// Enough arithmetic per pixel that the work, not the memory traffic or the
+// queue, is what costs
+internal_fn void bench_shade_tile(thread_context_t *thread, void *data) {
+  pixel_tile_t *tile = (pixel_tile_t *)data;
+  offscreen_buffer *buff = tile->buff;
+  for (int i = tile->start; i < tile->end; i += buff->bytes_per_px) {
+    uint32_t value = (uint32_t)i;
+    for (int round = 0; round < BENCH_SHADE_ROUNDS; round++) {
+      value = (value ^ (value >> 15)) * 2246822519u + tile->alpha;
+    }
+    buff->buffer[i] = (uint8_t)value;
+  }
+}
+
+internal_fn bench_result_t bench_worker_count(int worker_count) {
+  char worker_count_text[16];
+  snprintf(worker_count_text, sizeof(worker_count_text), "%d", worker_count);
+  setenv("WORKER_THREADS", worker_count_text, 1);
+  PlatformInitWorkQueue();
+
+  game_memory_t memory = {};
+  memory.permanent_storage_size = Megabytes(64);
+  memory.permanent_storage = calloc(1, memory.permanent_storage_size);
+  memory.work_queue = &work_queue;
+  memory.PlatformAddEntry = PlatformAddEntry;
+  memory.PlatformCompleteAllWork = PlatformCompleteAllWork;
+
+  thread_context_t thread = {};
+  game_input_t input = {};
+  // Fault the buffer in with the init pass, then let the first frame
+  // initialise the game state
+  game_init(&memory, &bench_screen);
+  game_update_and_render(&thread, &memory, &bench_screen, &input, 1 / 60.0f);
+
+  bench_result_t result = {};
+  result.worker_count = work_queue.worker_count;
+
+  uint64_t start = bench_now_ns();
+  for (int frame_i = 0; frame_i < BENCH_FRAMES; frame_i++) {
+    game_update_and_render(&thread, &memory, &bench_screen, &input,
+                           1 / 60.0f);
+  }
+  result.frame_ms = (bench_now_ns() - start) / 1000000.0 / BENCH_FRAMES;
+
+  start = bench_now_ns();
+  for (int pass_i = 0; pass_i < BENCH_SHADE_PASSES; pass_i++) {
+    game_run_pixel_pass(&memory, &bench_screen, bench_shade_tile,
+                        (uint8_t)pass_i);
+  }
+  result.shade_ms = (bench_now_ns() - start) / 1000000.0 / BENCH_SHADE_PASSES;
+  return result;
+}
+
+int main(int argc, char **argv) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  int cpu_count = 1;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    cpu_count = CPU_COUNT(&allowed);
+  }
+  int max_workers = argc > 1 ? atoi(argv[1]) : cpu_count;
+  max_workers = SDL_clamp(max_workers, 0, WORK_QUEUE_MAX_WORKERS);
+
+  printf("%d cores, %d pixel bands, %d frames\n", cpu_count, PIXEL_TILE_COUNT,
+         BENCH_FRAMES);
+  printf("%8s %10s %8s %10s %8s\n", "workers", "frame ms", "speedup",
+         "shade ms", "speedup");
+
+  bench_result_t baseline = {};
+  for (int worker_count = 0; worker_count <= max_workers; worker_count++) {
+    int result_pipe[2];
+    if (pipe(result_pipe) == -1) {
+      return 1;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+      bench_result_t result = bench_worker_count(worker_count);
+      write(result_pipe[1], &result, sizeof(result));
+      _exit(0);
+    }
+    close(result_pipe[1]);
+    bench_result_t result = {};
+    bool have_result =
+        child > 0 && read(result_pipe[0], &result, sizeof(result)) ==
+                         (ssize_t)sizeof(result);
+    close(result_pipe[0]);
+    if (child > 0) {
+      waitpid(child, NULL, 0);
+    }
+    if (!have_result) {
+      printf("%8d failed\n", worker_count);
+      continue;
+    }
+
+    if (worker_count == 0) {
+      baseline = result;
+    }
+    printf("%8d %10.3f %7.2fx %10.3f %7.2fx\n", result.worker_count,
+           result.frame_ms, baseline.frame_ms / result.frame_ms,
+           result.shade_ms, baseline.shade_ms / result.shade_ms);
+  }
+  return 0;
+}
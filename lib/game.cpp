@@ -1,8 +1,33 @@
 #include "game.h"
 
+#include "game_bitmap.cpp"
+#include "game_entity.cpp"
+#include "game_tile.cpp"
+
+// Full-frame pixel passes are split into bands of rows and spread over the
+// platform work queue
+#define PIXEL_TILE_COUNT 16
+
+#define GAME_MAX_ENTITIES 65536
+// Entities step at a fixed rate whatever the frame time, so a replay with the
+// recorded frame times lands on the same state. A long hitch is dropped
+// rather than caught up on
+#define GAME_ENTITY_STEP (1.0f / 120.0f)
+#define GAME_ENTITY_MAX_STEPS_PER_FRAME 8
+#define GAME_TILE_HASH_CAPACITY 4096
+
+typedef struct pixel_tile {
+  offscreen_buffer *buff;
+  int start;
+  int end;
+  uint8_t alpha;
+} pixel_tile_t;
+
 // RGBA
-internal_fn void game_init_pixels(offscreen_buffer *buff) {
-  for (int i = 0; i < buff->length; i += buff->bytes_per_px) {
+internal_fn void game_init_pixels_tile(thread_context_t *thread, void *data) {
+  pixel_tile_t *tile = (pixel_tile_t *)data;
+  offscreen_buffer *buff = tile->buff;
+  for (int i = tile->start; i < tile->end; i += buff->bytes_per_px) {
     buff->buffer[i] = 0xFF;
     buff->buffer[i + 1] = 0x00;
     buff->buffer[i + 2] = 0x00;
@@ -10,17 +35,73 @@ internal_fn void game_init_pixels(offscreen_buffer *buff) {
   }
 }
 
-internal_fn void game_update_pixels_alpha(offscreen_buffer *buff,
-                                          uint8_t alpha) {
-  for (int i = 0; i < buff->length; i += buff->bytes_per_px) {
+internal_fn void game_update_pixels_alpha_tile(thread_context_t *thread,
+                                               void *data) {
+  pixel_tile_t *tile = (pixel_tile_t *)data;
+  offscreen_buffer *buff = tile->buff;
+  for (int i = tile->start; i < tile->end; i += buff->bytes_per_px) {
     // int pixel_idx = i / buff->bytes_per_px;
 
-    buff->buffer[i + 3] = alpha;
+    buff->buffer[i + 3] = tile->alpha;
+  }
+}
+
+internal_fn void game_run_pixel_pass(game_memory_t *memory,
+                                     offscreen_buffer *buff,
+                                     platform_work_queue_callback *pass,
+                                     uint8_t alpha) {
+  pixel_tile_t tiles[PIXEL_TILE_COUNT];
+  int pitch = buff->width * buff->bytes_per_px;
+  int rows_per_tile = (buff->height + PIXEL_TILE_COUNT - 1) / PIXEL_TILE_COUNT;
+
+  for (int tile_i = 0; tile_i < PIXEL_TILE_COUNT; tile_i++) {
+    pixel_tile_t *tile = &tiles[tile_i];
+    tile->buff = buff;
+    tile->start = tile_i * rows_per_tile * pitch;
+    tile->end = (tile_i + 1) * rows_per_tile * pitch;
+    if (tile->end > buff->length) {
+      tile->end = buff->length;
+    }
+    tile->alpha = alpha;
+    memory->PlatformAddEntry(memory->work_queue, pass, tile);
+  }
+
+  // The tiles live on this stack frame
+  memory->PlatformCompleteAllWork(memory->work_queue);
+}
+
+internal_fn void game_init_pixels(game_memory_t *memory,
+                                  offscreen_buffer *buff) {
+  game_run_pixel_pass(memory, buff, game_init_pixels_tile, 0);
+}
+
+internal_fn void game_update_pixels_alpha(game_memory_t *memory,
+                                          offscreen_buffer *buff,
+                                          uint8_t alpha) {
+  game_run_pixel_pass(memory, buff, game_update_pixels_alpha_tile, alpha);
+}
+
+internal_fn void game_step_entities(game_state_t *state, float delta_time) {
+  // Nothing spawns entities yet, so an empty store costs nothing per frame
+  if (state->entities.count == 0) {
+    state->entity_step_accumulator = 0;
+    return;
+  }
+  state->entity_step_accumulator += delta_time;
+  int steps = 0;
+  while (state->entity_step_accumulator >= GAME_ENTITY_STEP &&
+         steps < GAME_ENTITY_MAX_STEPS_PER_FRAME) {
+    entity_integrate(&state->entities, GAME_ENTITY_STEP);
+    state->entity_step_accumulator -= GAME_ENTITY_STEP;
+    steps++;
+  }
+  if (steps == GAME_ENTITY_MAX_STEPS_PER_FRAME) {
+    state->entity_step_accumulator = 0;
   }
 }
 
 internal_fn void game_init(game_memory_t *memory, offscreen_buffer *buff) {
-  game_init_pixels(buff);
+  game_init_pixels(memory, buff);
 };
 
 extern "C" void game_update_and_render(thread_context_t *thread_context,
@@ -31,11 +112,26 @@ extern "C" void game_update_and_render(thread_context_t *thread_context,
   game_state_t *state = (game_state_t *)memory->permanent_storage;
   if (!memory->is_initialized) {
     memory->is_initialized = true;
-    game_init_pixels(buff);
+    game_init_pixels(memory, buff);
 
     state->alpha = 0x00;
+
+    initialize_arena(&state->world_arena,
+                     memory->permanent_storage_size - sizeof(game_state_t),
+                     (uint8_t *)memory->permanent_storage +
+                         sizeof(game_state_t));
+    entity_store_init(&state->entities, &state->world_arena,
+                      GAME_MAX_ENTITIES);
+    tile_map_init(&state->tile_map, &state->world_arena,
+                  GAME_TILE_HASH_CAPACITY);
   }
 
+  // Everything lives on the world arena in permanent storage, nothing is
+  // kept in transient storage across frames so all of it may be released
+  memory->permanent_storage_used =
+      sizeof(game_state_t) + state->world_arena.used;
+  memory->transient_storage_used = 0;
+
   if (input->controller.move_north.ended_down) {
     state->alpha++;
   } else if (input->controller.move_south.ended_down) {
@@ -44,5 +140,7 @@ extern "C" void game_update_and_render(thread_context_t *thread_context,
 
   // state->alpha++;
 
-  game_update_pixels_alpha(buff, state->alpha);
+  game_step_entities(state, delta_time);
+
+  game_update_pixels_alpha(memory, buff, state->alpha);
 };
@@ -71,13 +71,127 @@ typedef struct game_input {
 } game_input_t;
 
 typedef struct thread_context {
-  // Nothing yet
+  // 0 is the thread calling game_update_and_render, workers count up from 1
+  int logical_thread_index;
 } thread_context_t;
 
+// Platform layer implements the work queue, entries are run by a pool of
+// worker threads and by the caller of PlatformCompleteAllWork while it waits
+
+typedef struct platform_work_queue platform_work_queue;
+
+typedef void platform_work_queue_callback(thread_context_t *thread,
+                                          void *data);
+
+typedef void platform_add_entry_t(platform_work_queue *queue,
+                                  platform_work_queue_callback *callback,
+                                  void *data);
+typedef void platform_complete_all_work_t(platform_work_queue *queue);
+
+// Bump allocator over a block of game memory, push_size returns NULL when the
+// block is used up
+typedef struct memory_arena {
+  uint8_t *base;
+  uint64_t size;
+  uint64_t used;
+} memory_arena_t;
+
+#define push_struct(arena, type)                                               \
+  (type *)push_size(arena, sizeof(type), alignof(type))
+#define push_array(arena, count, type)                                         \
+  (type *)push_size(arena, (count) * sizeof(type), alignof(type))
+
+inline void initialize_arena(memory_arena_t *arena, uint64_t size,
+                             void *base) {
+  arena->base = (uint8_t *)base;
+  arena->size = size;
+  arena->used = 0;
+}
+
+inline void *push_size(memory_arena_t *arena, uint64_t size,
+                       uint64_t alignment) {
+  uint64_t address = (uint64_t)(arena->base + arena->used);
+  uint64_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+  if (arena->used + padding + size > arena->size) {
+    return 0;
+  }
+  void *result = arena->base + arena->used + padding;
+  arena->used += padding + size;
+  return result;
+}
+
+#include "game_bitmap.h"
+#include "game_entity.h"
+#include "game_tile.h"
+
 typedef struct game_state {
   uint8_t alpha;
+
+  memory_arena_t world_arena;
+  entity_store_t entities;
+  // Frame time not yet covered by a fixed entity step
+  float entity_step_accumulator;
+  tile_map_t tile_map;
 } game_state_t;
 
+// Sampled by the platform about once a second, the resident figures come
+// from mincore so they show what has actually been touched
+typedef struct game_memory_stats {
+  uint64_t permanent_resident_bytes;
+  uint64_t permanent_resident_peak_bytes;
+
+  uint64_t transient_resident_bytes;
+  uint64_t transient_resident_peak_bytes;
+  uint64_t transient_released_bytes;
+
+  uint64_t process_resident_bytes;
+  uint64_t process_resident_peak_bytes;
+  uint64_t minor_page_faults;
+  uint64_t major_page_faults;
+} game_memory_stats_t;
+
+// Hardware counters for one measured stretch of a frame, indexed by
+// game_perf_counter. counters has a bit set for each one the platform could
+// count, the rest read as zero. Miss rates are per thousand instructions.
+typedef enum game_perf_counter {
+  GAME_PERF_CYCLES,
+  GAME_PERF_INSTRUCTIONS,
+  GAME_PERF_L1D_MISSES,
+  GAME_PERF_LLC_MISSES,
+  GAME_PERF_BRANCH_MISSES,
+  GAME_PERF_PAGE_FAULTS,
+
+  GAME_PERF_COUNTER_COUNT,
+} game_perf_counter_t;
+
+typedef struct game_perf_sample {
+  uint32_t counters;
+  uint64_t values[GAME_PERF_COUNTER_COUNT];
+
+  float instructions_per_cycle;
+  float l1d_misses_per_kilo_instruction;
+  float llc_misses_per_kilo_instruction;
+  float branch_misses_per_kilo_instruction;
+} game_perf_sample_t;
+
+typedef struct game_perf_frame {
+  // game_update_and_render, on the calling thread only
+  game_perf_sample_t update;
+  // The platform uploading and presenting, which overlaps the update
+  game_perf_sample_t draw;
+} game_perf_frame_t;
+
+#define GAME_PERF_HISTORY 128
+
+// Filled in by the platform between frames, during an update the newest
+// entry, frames[(frame_count - 1) % GAME_PERF_HISTORY], is the frame before
+typedef struct game_perf_history {
+  uint64_t frame_count;
+  game_perf_frame_t frames[GAME_PERF_HISTORY];
+} game_perf_history_t;
+
+#define GAME_STORAGE_USED_UNKNOWN UINT64_MAX
+
 typedef struct game_memory {
   uint64_t permanent_storage_size;
   void *permanent_storage;
@@ -85,6 +199,21 @@ typedef struct game_memory {
   uint64_t transient_storage_size;
   void *transient_storage;
 
+  // High-water marks of the storage the game is using, set by the game. The
+  // permanent one is only reported in the memory log. Transient pages past
+  // transient_storage_used may be handed back to the OS between frames and
+  // read as zero, until the game sets it, it is GAME_STORAGE_USED_UNKNOWN
+  // and nothing is released
+  uint64_t permanent_storage_used;
+  uint64_t transient_storage_used;
+
+  game_memory_stats_t stats;
+  game_perf_history_t perf;
+
+  platform_work_queue *work_queue;
+  platform_add_entry_t *PlatformAddEntry;
+  platform_complete_all_work_t *PlatformCompleteAllWork;
+
   bool is_initialized;
 } game_memory_t;
 
@@ -0,0 +1,374 @@
+#include "game.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// File formats are little endian and their fields aren't aligned
+internal_fn uint16_t bitmap_read_u16(uint8_t *at) {
+  return (uint16_t)(at[0] | (at[1] << 8));
+}
+
+internal_fn uint32_t bitmap_read_u32(uint8_t *at) {
+  return (uint32_t)at[0] | ((uint32_t)at[1] << 8) | ((uint32_t)at[2] << 16) |
+         ((uint32_t)at[3] << 24);
+}
+
+// A channel is pulled out of a source pixel by mask and shift, which covers
+// BGR, BGRA and whatever bitfield layout a BMP declares
+typedef struct bitmap_channel {
+  uint32_t mask;
+  uint32_t shift;
+  uint32_t max;
+} bitmap_channel_t;
+
+typedef struct bitmap_source {
+  // Rows are walked from first_row by row_stride, which is negative for
+  // bottom-up files
+  uint8_t *first_row;
+  int64_t row_stride;
+  int32_t bytes_per_px;
+  int32_t width;
+  int32_t height;
+
+  bitmap_channel_t red;
+  bitmap_channel_t green;
+  bitmap_channel_t blue;
+  // No mask means the image is opaque
+  bitmap_channel_t alpha;
+} bitmap_source_t;
+
+// A zero mask is a channel that always reads 0, max is left at 8 bits so it
+// is never scaled
+internal_fn bitmap_channel_t bitmap_channel_from_mask(uint32_t mask) {
+  bitmap_channel_t channel = {.mask = 0, .shift = 0, .max = 0xFF};
+  if (mask) {
+    channel.mask = mask;
+    channel.shift = __builtin_ctz(mask);
+    channel.max = mask >> channel.shift;
+  }
+  return channel;
+}
+
+// Scales the channel to 8 bits, max is at most 16 bits so value * 255 fits
+internal_fn uint32_t bitmap_channel_value(bitmap_channel_t channel,
+                                          uint32_t pixel) {
+  uint32_t value = (pixel & channel.mask) >> channel.shift;
+  if (channel.max != 0xFF) {
+    value = (value * 255 + channel.max / 2) / channel.max;
+  }
+  return value;
+}
+
+// Rounds c * a / 255 to nearest
+internal_fn uint32_t bitmap_premultiply(uint32_t colour, uint32_t alpha) {
+  uint32_t t = colour * alpha + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+// The only pass over the source pixels, everything that would otherwise be
+// done per draw happens here
+internal_fn bool bitmap_convert(bitmap_source_t *source, memory_arena_t *arena,
+                                loaded_bitmap_t *result) {
+  int32_t pitch = (source->width * BITMAP_BYTES_PER_PX + BITMAP_ALIGNMENT - 1) &
+                  ~(BITMAP_ALIGNMENT - 1);
+  uint8_t *pixels = (uint8_t *)push_size(arena, (uint64_t)pitch * source->height,
+                                         BITMAP_ALIGNMENT);
+  if (!pixels) {
+    return false;
+  }
+
+  bool opaque = source->alpha.mask == 0;
+  uint8_t *source_row = source->first_row;
+  uint8_t *dest_row = pixels;
+  for (int32_t y = 0; y < source->height; y++) {
+    uint8_t *source_px = source_row;
+    uint8_t *dest_px = dest_row;
+    for (int32_t x = 0; x < source->width; x++) {
+      uint32_t pixel;
+      if (source->bytes_per_px == 4) {
+        pixel = bitmap_read_u32(source_px);
+      } else if (source->bytes_per_px == 3) {
+        pixel = source_px[0] | (source_px[1] << 8) | (source_px[2] << 16);
+      } else {
+        pixel = bitmap_read_u16(source_px);
+      }
+      source_px += source->bytes_per_px;
+
+      uint32_t red = bitmap_channel_value(source->red, pixel);
+      uint32_t green = bitmap_channel_value(source->green, pixel);
+      uint32_t blue = bitmap_channel_value(source->blue, pixel);
+      uint32_t alpha = 0xFF;
+      if (!opaque) {
+        alpha = bitmap_channel_value(source->alpha, pixel);
+        red = bitmap_premultiply(red, alpha);
+        green = bitmap_premultiply(green, alpha);
+        blue = bitmap_premultiply(blue, alpha);
+      }
+
+      dest_px[0] = (uint8_t)alpha;
+      dest_px[1] = (uint8_t)blue;
+      dest_px[2] = (uint8_t)green;
+      dest_px[3] = (uint8_t)red;
+      dest_px += BITMAP_BYTES_PER_PX;
+    }
+
+    // Transparent padding, the arena may hand back memory that was used
+    for (uint8_t *pad = dest_px; pad < dest_row + pitch; pad++) {
+      *pad = 0;
+    }
+
+    source_row += source->row_stride;
+    dest_row += pitch;
+  }
+
+  result->width = source->width;
+  result->height = source->height;
+  result->pitch = pitch;
+  result->pixels = pixels;
+  return true;
+}
+
+// Uncompressed 16, 24 and 32 bit BMPs with a BITMAPINFOHEADER or later,
+// including BI_BITFIELDS and BI_ALPHABITFIELDS. 32 bit BI_RGB files have
+// no defined alpha so they load opaque.
+internal_fn bool bitmap_parse_bmp(uint8_t *file, uint32_t file_size,
+                                  bitmap_source_t *source) {
+  if (file_size < 54 || file[0] != 'B' || file[1] != 'M') {
+    return false;
+  }
+
+  uint32_t pixel_offset = bitmap_read_u32(file + 10);
+  uint32_t header_size = bitmap_read_u32(file + 14);
+  int32_t width = (int32_t)bitmap_read_u32(file + 18);
+  int32_t height = (int32_t)bitmap_read_u32(file + 22);
+  uint16_t bits_per_px = bitmap_read_u16(file + 28);
+  uint32_t compression = bitmap_read_u32(file + 30);
+  if (header_size < 40 || width <= 0 || height == 0 || width > 0xFFFF ||
+      height < -0xFFFF || height > 0xFFFF) {
+    return false;
+  }
+
+  uint32_t red_mask, green_mask, blue_mask, alpha_mask = 0;
+  if (compression == 0) {
+    if (bits_per_px == 16) {
+      red_mask = 0x7C00;
+      green_mask = 0x03E0;
+      blue_mask = 0x001F;
+    } else if (bits_per_px == 24 || bits_per_px == 32) {
+      red_mask = 0x00FF0000;
+      green_mask = 0x0000FF00;
+      blue_mask = 0x000000FF;
+    } else {
+      return false;
+    }
+  } else if ((compression == 3 || compression == 6) &&
+             (bits_per_px == 16 || bits_per_px == 32)) {
+    // The masks follow a 40 byte header and sit at the same place inside
+    // the V4 and V5 headers
+    bool has_alpha_mask = compression == 6 || header_size >= 56;
+    if (file_size < (has_alpha_mask ? 70u : 66u)) {
+      return false;
+    }
+    red_mask = bitmap_read_u32(file + 54);
+    green_mask = bitmap_read_u32(file + 58);
+    blue_mask = bitmap_read_u32(file + 62);
+    if (has_alpha_mask) {
+      alpha_mask = bitmap_read_u32(file + 66);
+    }
+  } else {
+    // RLE, embedded JPEG or PNG and palettes aren't supported
+    return false;
+  }
+
+  bool top_down = height < 0;
+  if (top_down) {
+    height = -height;
+  }
+
+  uint64_t file_stride = (((uint64_t)width * bits_per_px + 31) / 32) * 4;
+  if ((uint64_t)pixel_offset + file_stride * height > file_size) {
+    return false;
+  }
+
+  source->width = width;
+  source->height = height;
+  source->bytes_per_px = bits_per_px / 8;
+  if (top_down) {
+    source->first_row = file + pixel_offset;
+    source->row_stride = (int64_t)file_stride;
+  } else {
+    source->first_row = file + pixel_offset + file_stride * (height - 1);
+    source->row_stride = -(int64_t)file_stride;
+  }
+  source->red = bitmap_channel_from_mask(red_mask);
+  source->green = bitmap_channel_from_mask(green_mask);
+  source->blue = bitmap_channel_from_mask(blue_mask);
+  source->alpha = bitmap_channel_from_mask(alpha_mask);
+
+  // Wider channels would overflow the scaling to 8 bits
+  bitmap_channel_t channels[] = {source->red, source->green, source->blue,
+                                 source->alpha};
+  for (uint32_t channel_i = 0; channel_i < array_length(channels);
+       channel_i++) {
+    if (channels[channel_i].max > 0xFFFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Uncompressed true colour TGAs (image type 2), 24 or 32 bit, either origin
+internal_fn bool bitmap_parse_tga(uint8_t *file, uint32_t file_size,
+                                  bitmap_source_t *source) {
+  if (file_size < 18) {
+    return false;
+  }
+
+  uint8_t id_length = file[0];
+  uint8_t colour_map_type = file[1];
+  uint8_t image_type = file[2];
+  int32_t width = bitmap_read_u16(file + 12);
+  int32_t height = bitmap_read_u16(file + 14);
+  uint8_t bits_per_px = file[16];
+  uint8_t descriptor = file[17];
+  bool right_to_left = descriptor & 0x10;
+  bool top_down = descriptor & 0x20;
+  if (colour_map_type != 0 || image_type != 2 ||
+      (bits_per_px != 24 && bits_per_px != 32) || width == 0 || height == 0 ||
+      right_to_left) {
+    return false;
+  }
+
+  uint64_t pixel_offset = 18 + id_length;
+  uint64_t file_stride = (uint64_t)width * (bits_per_px / 8);
+  if (pixel_offset + file_stride * height > file_size) {
+    return false;
+  }
+
+  source->width = width;
+  source->height = height;
+  source->bytes_per_px = bits_per_px / 8;
+  if (top_down) {
+    source->first_row = file + pixel_offset;
+    source->row_stride = (int64_t)file_stride;
+  } else {
+    source->first_row = file + pixel_offset + file_stride * (height - 1);
+    source->row_stride = -(int64_t)file_stride;
+  }
+  source->red = bitmap_channel_from_mask(0x00FF0000);
+  source->green = bitmap_channel_from_mask(0x0000FF00);
+  source->blue = bitmap_channel_from_mask(0x000000FF);
+  source->alpha = bitmap_channel_from_mask(bits_per_px == 32 ? 0xFF000000 : 0);
+  return true;
+}
+
+// Decodes a BMP or TGA already read into memory, the pixels go on the arena
+// and the file contents aren't needed afterwards. Returns false and leaves
+// the arena alone when the file isn't a supported image.
+inline bool bitmap_load(loaded_bitmap_t *result, memory_arena_t *arena,
+                        void *file_contents, uint32_t file_size) {
+  *result = {};
+  uint8_t *file = (uint8_t *)file_contents;
+  bitmap_source_t source = {};
+
+  bool parsed;
+  if (file_size >= 2 && file[0] == 'B' && file[1] == 'M') {
+    parsed = bitmap_parse_bmp(file, file_size, &source);
+  } else {
+    // TGA has no magic number, the header checks have to do
+    parsed = bitmap_parse_tga(file, file_size, &source);
+  }
+
+  return parsed && bitmap_convert(&source, arena, result);
+}
+
+internal_fn void bitmap_blend_px(uint8_t *dest, uint8_t *source) {
+  uint32_t inverse_alpha = 255 - source[0];
+  for (int channel = 0; channel < BITMAP_BYTES_PER_PX; channel++) {
+    dest[channel] = (uint8_t)(source[channel] +
+                              bitmap_premultiply(dest[channel], inverse_alpha));
+  }
+}
+
+// Composites the bitmap over the buffer with its top left corner at x, y,
+// clipped to the buffer
+inline void bitmap_draw(offscreen_buffer *buff, loaded_bitmap_t *bitmap,
+                        int32_t x, int32_t y) {
+  int32_t min_x = x < 0 ? 0 : x;
+  int32_t min_y = y < 0 ? 0 : y;
+  int32_t max_x = x + bitmap->width;
+  int32_t max_y = y + bitmap->height;
+  if (max_x > buff->width) {
+    max_x = buff->width;
+  }
+  if (max_y > buff->height) {
+    max_y = buff->height;
+  }
+  if (min_x >= max_x || min_y >= max_y) {
+    return;
+  }
+
+  int32_t dest_pitch = buff->width * buff->bytes_per_px;
+  int32_t span = max_x - min_x;
+  uint8_t *source_row = bitmap->pixels + (min_y - y) * bitmap->pitch +
+                        (min_x - x) * BITMAP_BYTES_PER_PX;
+  uint8_t *dest_row =
+      buff->buffer + min_y * dest_pitch + min_x * BITMAP_BYTES_PER_PX;
+
+#if defined(__x86_64__)
+  __m128i zero = _mm_setzero_si128();
+  __m128i max_channel = _mm_set1_epi16(255);
+  __m128i half = _mm_set1_epi16(128);
+#endif
+
+  for (int32_t row = min_y; row < max_y; row++) {
+    uint8_t *source_px = source_row;
+    uint8_t *dest_px = dest_row;
+    int32_t column = 0;
+
+#if defined(__x86_64__)
+
+    // Four pixels at a time widened to 16 bits per channel, alpha is the
+    // first channel of each pixel so it's broadcast with a shuffle
+    for (; column + 4 <= span; column += 4) {
+      __m128i source_4 = _mm_loadu_si128((__m128i *)source_px);
+      __m128i dest_4 = _mm_loadu_si128((__m128i *)dest_px);
+
+      __m128i source_lo = _mm_unpacklo_epi8(source_4, zero);
+      __m128i source_hi = _mm_unpackhi_epi8(source_4, zero);
+      __m128i dest_lo = _mm_unpacklo_epi8(dest_4, zero);
+      __m128i dest_hi = _mm_unpackhi_epi8(dest_4, zero);
+
+      __m128i inverse_lo = _mm_sub_epi16(
+          max_channel,
+          _mm_shufflehi_epi16(_mm_shufflelo_epi16(source_lo, 0), 0));
+      __m128i inverse_hi = _mm_sub_epi16(
+          max_channel,
+          _mm_shufflehi_epi16(_mm_shufflelo_epi16(source_hi, 0), 0));
+
+      __m128i t_lo = _mm_add_epi16(_mm_mullo_epi16(dest_lo, inverse_lo), half);
+      __m128i t_hi = _mm_add_epi16(_mm_mullo_epi16(dest_hi, inverse_hi), half);
+      t_lo = _mm_srli_epi16(_mm_add_epi16(t_lo, _mm_srli_epi16(t_lo, 8)), 8);
+      t_hi = _mm_srli_epi16(_mm_add_epi16(t_hi, _mm_srli_epi16(t_hi, 8)), 8);
+
+      __m128i result = _mm_packus_epi16(_mm_add_epi16(source_lo, t_lo),
+                                        _mm_add_epi16(source_hi, t_hi));
+      _mm_storeu_si128((__m128i *)dest_px, result);
+
+      source_px += 4 * BITMAP_BYTES_PER_PX;
+      dest_px += 4 * BITMAP_BYTES_PER_PX;
+    }
+
+#endif
+
+    for (; column < span; column++) {
+      bitmap_blend_px(dest_px, source_px);
+      source_px += BITMAP_BYTES_PER_PX;
+      dest_px += BITMAP_BYTES_PER_PX;
+    }
+
+    source_row += bitmap->pitch;
+    dest_row += dest_pitch;
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef GAME_BITMAP_H_
+
+#include <stdint.h>
+
+// Images are decoded once, at load, into the layout the offscreen buffer
+// uses: 4 bytes per pixel in the platform texture's SDL_PIXELFORMAT_RGBA8888,
+// which is a, b, g, r in memory, rows top-down. Colour is premultiplied by
+// alpha so drawing is dest = src + dest * (1 - src_alpha) with no per-pixel
+// conversion. Each row starts on a BITMAP_ALIGNMENT boundary and the padding
+// past the width is transparent black, which blends to a no-op.
+
+#define BITMAP_ALIGNMENT 32
+#define BITMAP_BYTES_PER_PX 4
+
+typedef struct loaded_bitmap {
+  int32_t width;
+  int32_t height;
+  // Bytes between rows, a multiple of BITMAP_ALIGNMENT
+  int32_t pitch;
+  uint8_t *pixels;
+} loaded_bitmap_t;
+
+#define GAME_BITMAP_H_
+#endif
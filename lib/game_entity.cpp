@@ -0,0 +1,149 @@
+#include "game.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+inline bool entity_store_init(entity_store_t *store, memory_arena_t *arena,
+                              uint32_t capacity) {
+  // Rounding up mustn't wrap, and the free list needs at least one slot
+  if (capacity == 0 || capacity > UINT32_MAX - (ENTITY_SIMD_WIDTH - 1)) {
+    store->capacity = 0;
+    store->count = 0;
+    return false;
+  }
+  capacity = (capacity + ENTITY_SIMD_WIDTH - 1) & ~(ENTITY_SIMD_WIDTH - 1);
+
+  store->capacity = capacity;
+  store->count = 0;
+  store->position_x =
+      (float *)push_size(arena, capacity * sizeof(float), ENTITY_ALIGNMENT);
+  store->position_y =
+      (float *)push_size(arena, capacity * sizeof(float), ENTITY_ALIGNMENT);
+  store->velocity_x =
+      (float *)push_size(arena, capacity * sizeof(float), ENTITY_ALIGNMENT);
+  store->velocity_y =
+      (float *)push_size(arena, capacity * sizeof(float), ENTITY_ALIGNMENT);
+  store->flags = push_array(arena, capacity, uint32_t);
+  store->dense_to_slot = push_array(arena, capacity, uint32_t);
+  store->slot_to_dense = push_array(arena, capacity, uint32_t);
+  store->slot_generation = push_array(arena, capacity, uint32_t);
+
+  if (!store->position_x || !store->position_y || !store->velocity_x ||
+      !store->velocity_y || !store->flags || !store->dense_to_slot ||
+      !store->slot_to_dense || !store->slot_generation) {
+    store->capacity = 0;
+    return false;
+  }
+
+  // Generations start at 1 so a zeroed handle never resolves
+  for (uint32_t slot = 0; slot < capacity; slot++) {
+    store->slot_to_dense[slot] = slot + 1;
+    store->slot_generation[slot] = 1;
+  }
+  store->slot_to_dense[capacity - 1] = ENTITY_INVALID_INDEX;
+  store->free_slot_head = 0;
+  return true;
+}
+
+// Returns the dense index of the entity or ENTITY_INVALID_INDEX when the
+// handle is stale
+inline uint32_t entity_lookup(entity_store_t *store,
+                              entity_handle_t handle) {
+  if (handle.slot >= store->capacity ||
+      store->slot_generation[handle.slot] != handle.generation) {
+    return ENTITY_INVALID_INDEX;
+  }
+  return store->slot_to_dense[handle.slot];
+}
+
+// Returns a zeroed handle when the store is full
+inline entity_handle_t entity_add(entity_store_t *store, float position_x,
+                                  float position_y, float velocity_x,
+                                  float velocity_y, uint32_t flags) {
+  entity_handle_t handle = {};
+  uint32_t slot = store->free_slot_head;
+  if (slot == ENTITY_INVALID_INDEX || store->capacity == 0) {
+    return handle;
+  }
+  store->free_slot_head = store->slot_to_dense[slot];
+
+  uint32_t dense = store->count++;
+  store->position_x[dense] = position_x;
+  store->position_y[dense] = position_y;
+  store->velocity_x[dense] = velocity_x;
+  store->velocity_y[dense] = velocity_y;
+  store->flags[dense] = flags;
+  store->dense_to_slot[dense] = slot;
+  store->slot_to_dense[slot] = dense;
+
+  handle.slot = slot;
+  handle.generation = store->slot_generation[slot];
+  return handle;
+}
+
+inline bool entity_remove(entity_store_t *store, entity_handle_t handle) {
+  uint32_t dense = entity_lookup(store, handle);
+  if (dense == ENTITY_INVALID_INDEX) {
+    return false;
+  }
+
+  // Swap the last entity into the hole to keep the arrays packed
+  uint32_t last = --store->count;
+  if (dense != last) {
+    store->position_x[dense] = store->position_x[last];
+    store->position_y[dense] = store->position_y[last];
+    store->velocity_x[dense] = store->velocity_x[last];
+    store->velocity_y[dense] = store->velocity_y[last];
+    store->flags[dense] = store->flags[last];
+
+    uint32_t moved_slot = store->dense_to_slot[last];
+    store->dense_to_slot[dense] = moved_slot;
+    store->slot_to_dense[moved_slot] = dense;
+  }
+
+  store->slot_generation[handle.slot]++;
+  store->slot_to_dense[handle.slot] = store->free_slot_head;
+  store->free_slot_head = handle.slot;
+  return true;
+}
+
+// Runs over whole SIMD widths, the padding past count is never read by
+// anything else so it's fine to integrate whatever is in it
+inline void entity_integrate(entity_store_t *store, float delta_time) {
+  uint32_t padded_count =
+      (store->count + ENTITY_SIMD_WIDTH - 1) & ~(ENTITY_SIMD_WIDTH - 1);
+  float *position_x = store->position_x;
+  float *position_y = store->position_y;
+  float *velocity_x = store->velocity_x;
+  float *velocity_y = store->velocity_y;
+
+#if defined(__x86_64__)
+
+  __m128 dt = _mm_set1_ps(delta_time);
+  for (uint32_t i = 0; i < padded_count; i += ENTITY_SIMD_WIDTH) {
+    __m128 px0 = _mm_load_ps(position_x + i);
+    __m128 px1 = _mm_load_ps(position_x + i + 4);
+    __m128 py0 = _mm_load_ps(position_y + i);
+    __m128 py1 = _mm_load_ps(position_y + i + 4);
+
+    px0 = _mm_add_ps(px0, _mm_mul_ps(_mm_load_ps(velocity_x + i), dt));
+    px1 = _mm_add_ps(px1, _mm_mul_ps(_mm_load_ps(velocity_x + i + 4), dt));
+    py0 = _mm_add_ps(py0, _mm_mul_ps(_mm_load_ps(velocity_y + i), dt));
+    py1 = _mm_add_ps(py1, _mm_mul_ps(_mm_load_ps(velocity_y + i + 4), dt));
+
+    _mm_store_ps(position_x + i, px0);
+    _mm_store_ps(position_x + i + 4, px1);
+    _mm_store_ps(position_y + i, py0);
+    _mm_store_ps(position_y + i + 4, py1);
+  }
+
+#else
+
+  for (uint32_t i = 0; i < padded_count; i++) {
+    position_x[i] += velocity_x[i] * delta_time;
+    position_y[i] += velocity_y[i] * delta_time;
+  }
+
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef GAME_ENTITY_H_
+
+#include <stdint.h>
+
+// Entities are kept as parallel arrays (SoA) so the per-frame passes stream
+// through only the fields they touch. Dense arrays hold the live entities in
+// [0, count) and stay packed by swapping the last entity into any hole.
+// Handles go through a sparse slot table with a generation per slot, so a
+// handle to a removed entity never resolves to whatever moved into its place.
+
+#define ENTITY_INVALID_INDEX 0xFFFFFFFF
+
+// Arrays are padded out to a whole number of these so the SIMD pass never
+// needs a scalar tail
+#define ENTITY_SIMD_WIDTH 8
+#define ENTITY_ALIGNMENT 32
+
+#define ENTITY_FLAG_SOLID (1 << 0)
+#define ENTITY_FLAG_VISIBLE (1 << 1)
+
+typedef struct entity_handle {
+  uint32_t slot;
+  uint32_t generation;
+} entity_handle_t;
+
+typedef struct entity_store {
+  uint32_t capacity;
+  uint32_t count;
+
+  // Dense
+  float *position_x;
+  float *position_y;
+  float *velocity_x;
+  float *velocity_y;
+  uint32_t *flags;
+  uint32_t *dense_to_slot;
+
+  // Sparse, free slots are chained through slot_to_dense
+  uint32_t *slot_to_dense;
+  uint32_t *slot_generation;
+  uint32_t free_slot_head;
+} entity_store_t;
+
+#define GAME_ENTITY_H_
+#endif
@@ -0,0 +1,210 @@
+#include "game.h"
+
+inline bool tile_map_init(tile_map_t *map, memory_arena_t *arena,
+                          uint32_t hash_capacity) {
+  // Round up to a power of two so the probe can mask
+  uint32_t capacity = 1;
+  while (capacity < hash_capacity) {
+    capacity <<= 1;
+  }
+
+  map->arena = arena;
+  map->hash_capacity = capacity;
+  map->chunk_count = 0;
+  map->cached_chunk = 0;
+  map->slots = push_array(arena, capacity, tile_hash_slot_t);
+  if (!map->slots) {
+    map->hash_capacity = 0;
+    return false;
+  }
+  for (uint32_t slot_i = 0; slot_i < capacity; slot_i++) {
+    map->slots[slot_i].chunk = 0;
+  }
+  return true;
+}
+
+internal_fn uint32_t tile_chunk_hash(int32_t chunk_x, int32_t chunk_y) {
+  uint32_t hash = (uint32_t)chunk_x * 0x9E3779B1u + (uint32_t)chunk_y;
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6Bu;
+  return hash ^ (hash >> 13);
+}
+
+// Returns the slot holding the chunk, or the empty slot it would go in
+internal_fn tile_hash_slot_t *tile_map_find_slot(tile_map_t *map,
+                                                 int32_t chunk_x,
+                                                 int32_t chunk_y) {
+  uint32_t mask = map->hash_capacity - 1;
+  uint32_t slot_i = tile_chunk_hash(chunk_x, chunk_y) & mask;
+  for (;;) {
+    tile_hash_slot_t *slot = &map->slots[slot_i];
+    if (!slot->chunk ||
+        (slot->chunk_x == chunk_x && slot->chunk_y == chunk_y)) {
+      return slot;
+    }
+    slot_i = (slot_i + 1) & mask;
+  }
+}
+
+internal_fn tile_chunk_t *tile_map_hash_lookup(tile_map_t *map,
+                                               int32_t chunk_x,
+                                               int32_t chunk_y) {
+  if (map->hash_capacity == 0) {
+    return 0;
+  }
+  return tile_map_find_slot(map, chunk_x, chunk_y)->chunk;
+}
+
+internal_fn tile_chunk_t *tile_map_create_chunk(tile_map_t *map,
+                                                tile_hash_slot_t *slot,
+                                                int32_t chunk_x,
+                                                int32_t chunk_y) {
+  if ((map->chunk_count + 1) * 2 > map->hash_capacity) {
+    return 0;
+  }
+  tile_chunk_t *chunk = push_struct(map->arena, tile_chunk_t);
+  if (!chunk) {
+    return 0;
+  }
+
+  chunk->chunk_x = chunk_x;
+  chunk->chunk_y = chunk_y;
+  for (int tile_i = 0; tile_i < TILE_CHUNK_DIM * TILE_CHUNK_DIM; tile_i++) {
+    chunk->tiles[tile_i] = TILE_EMPTY;
+  }
+
+  chunk->west = tile_map_hash_lookup(map, chunk_x - 1, chunk_y);
+  chunk->east = tile_map_hash_lookup(map, chunk_x + 1, chunk_y);
+  chunk->north = tile_map_hash_lookup(map, chunk_x, chunk_y - 1);
+  chunk->south = tile_map_hash_lookup(map, chunk_x, chunk_y + 1);
+  if (chunk->west) {
+    chunk->west->east = chunk;
+  }
+  if (chunk->east) {
+    chunk->east->west = chunk;
+  }
+  if (chunk->north) {
+    chunk->north->south = chunk;
+  }
+  if (chunk->south) {
+    chunk->south->north = chunk;
+  }
+
+  slot->chunk_x = chunk_x;
+  slot->chunk_y = chunk_y;
+  slot->chunk = chunk;
+  map->chunk_count++;
+  return chunk;
+}
+
+// Tries the cached chunk and its neighbours before hashing, create makes
+// the chunk if it isn't there yet
+internal_fn tile_chunk_t *tile_map_get_chunk(tile_map_t *map, int32_t chunk_x,
+                                             int32_t chunk_y, bool create) {
+  tile_chunk_t *cached = map->cached_chunk;
+  if (cached) {
+    int32_t dx = chunk_x - cached->chunk_x;
+    int32_t dy = chunk_y - cached->chunk_y;
+    if (dx == 0 && dy == 0) {
+      return cached;
+    }
+
+    tile_chunk_t *neighbour = 0;
+    bool is_neighbour = true;
+    if (dy == 0 && dx == -1) {
+      neighbour = cached->west;
+    } else if (dy == 0 && dx == 1) {
+      neighbour = cached->east;
+    } else if (dx == 0 && dy == -1) {
+      neighbour = cached->north;
+    } else if (dx == 0 && dy == 1) {
+      neighbour = cached->south;
+    } else {
+      is_neighbour = false;
+    }
+
+    if (is_neighbour && (neighbour || !create)) {
+      if (neighbour) {
+        map->cached_chunk = neighbour;
+      }
+      return neighbour;
+    }
+  }
+
+  if (map->hash_capacity == 0) {
+    return 0;
+  }
+  tile_hash_slot_t *slot = tile_map_find_slot(map, chunk_x, chunk_y);
+  tile_chunk_t *chunk = slot->chunk;
+  if (!chunk && create) {
+    chunk = tile_map_create_chunk(map, slot, chunk_x, chunk_y);
+  }
+  if (chunk) {
+    map->cached_chunk = chunk;
+  }
+  return chunk;
+}
+
+inline uint8_t tile_map_get(tile_map_t *map, int32_t tile_x, int32_t tile_y) {
+  tile_chunk_t *chunk = tile_map_get_chunk(map, tile_x >> TILE_CHUNK_SHIFT,
+                                           tile_y >> TILE_CHUNK_SHIFT, false);
+  if (!chunk) {
+    return TILE_EMPTY;
+  }
+  return chunk->tiles[(tile_y & TILE_CHUNK_MASK) * TILE_CHUNK_DIM +
+                      (tile_x & TILE_CHUNK_MASK)];
+}
+
+// Returns false when the chunk couldn't be made because the map is full
+inline bool tile_map_set(tile_map_t *map, int32_t tile_x, int32_t tile_y,
+                         uint8_t value) {
+  // Clearing a tile never needs a chunk
+  bool create = value != TILE_EMPTY;
+  tile_chunk_t *chunk = tile_map_get_chunk(map, tile_x >> TILE_CHUNK_SHIFT,
+                                           tile_y >> TILE_CHUNK_SHIFT, create);
+  if (!chunk) {
+    return !create;
+  }
+  chunk->tiles[(tile_y & TILE_CHUNK_MASK) * TILE_CHUNK_DIM +
+               (tile_x & TILE_CHUNK_MASK)] = value;
+  return true;
+}
+
+// Visits the chunks overlapping a buffer whose top left corner is at
+// camera_x, camera_y in pixels, row by row. Each row hashes once and then
+// follows the east links, only hashing again after a gap
+inline tile_chunk_iterator_t tile_map_visible_chunks(tile_map_t *map,
+                                                    int32_t camera_x,
+                                                    int32_t camera_y,
+                                                    offscreen_buffer *buff) {
+  // Shifts rather than division so negative coordinates round down
+  int32_t chunk_px_shift = TILE_CHUNK_SHIFT + TILE_SIZE_PX_SHIFT;
+
+  tile_chunk_iterator_t it = {};
+  it.map = map;
+  it.min_chunk_x = camera_x >> chunk_px_shift;
+  it.max_chunk_x = (camera_x + buff->width - 1) >> chunk_px_shift;
+  it.chunk_y = camera_y >> chunk_px_shift;
+  it.max_chunk_y = (camera_y + buff->height - 1) >> chunk_px_shift;
+  it.chunk_x = it.min_chunk_x;
+  return it;
+}
+
+inline tile_chunk_t *tile_map_next_visible_chunk(tile_chunk_iterator_t *it) {
+  while (it->chunk_y <= it->max_chunk_y) {
+    while (it->chunk_x <= it->max_chunk_x) {
+      tile_chunk_t *chunk =
+          it->previous ? it->previous->east
+                       : tile_map_hash_lookup(it->map, it->chunk_x, it->chunk_y);
+      it->previous = chunk;
+      it->chunk_x++;
+      if (chunk) {
+        return chunk;
+      }
+    }
+    it->chunk_x = it->min_chunk_x;
+    it->chunk_y++;
+    it->previous = 0;
+  }
+  return 0;
+}
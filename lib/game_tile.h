@@ -0,0 +1,65 @@
+#ifndef GAME_TILE_H_
+
+#include <stdint.h>
+
+// The world is split into square chunks of tiles that only exist once
+// something is written into them. Chunks are found through an open
+// addressing hash table keyed on chunk coordinates, and each chunk links to
+// the chunks around it so walking across the map, or across the screen,
+// mostly follows pointers instead of hashing. A NULL link always means
+// there's no chunk there, links are made when a chunk is created.
+
+#define TILE_CHUNK_SHIFT 4
+#define TILE_CHUNK_DIM (1 << TILE_CHUNK_SHIFT)
+#define TILE_CHUNK_MASK (TILE_CHUNK_DIM - 1)
+
+#define TILE_SIZE_PX_SHIFT 4
+#define TILE_SIZE_PX (1 << TILE_SIZE_PX_SHIFT)
+
+#define TILE_EMPTY 0
+
+typedef struct tile_chunk {
+  int32_t chunk_x;
+  int32_t chunk_y;
+
+  struct tile_chunk *west;
+  struct tile_chunk *east;
+  struct tile_chunk *north;
+  struct tile_chunk *south;
+
+  uint8_t tiles[TILE_CHUNK_DIM * TILE_CHUNK_DIM];
+} tile_chunk_t;
+
+// Coordinates are kept in the slot so probing doesn't touch the chunks
+typedef struct tile_hash_slot {
+  int32_t chunk_x;
+  int32_t chunk_y;
+  tile_chunk_t *chunk;
+} tile_hash_slot_t;
+
+typedef struct tile_map {
+  memory_arena_t *arena;
+
+  // Power of two, kept at most half full
+  uint32_t hash_capacity;
+  uint32_t chunk_count;
+  tile_hash_slot_t *slots;
+
+  // Last chunk a lookup landed on
+  tile_chunk_t *cached_chunk;
+} tile_map_t;
+
+typedef struct tile_chunk_iterator {
+  tile_map_t *map;
+  int32_t min_chunk_x;
+  int32_t max_chunk_x;
+  int32_t max_chunk_y;
+  int32_t chunk_x;
+  int32_t chunk_y;
+
+  // The chunk just west of chunk_x, or NULL at the start of a row or a gap
+  tile_chunk_t *previous;
+} tile_chunk_iterator_t;
+
+#define GAME_TILE_H_
+#endif
@@ -0,0 +1,386 @@
+// Input bindings and dispatch, included by linux_platform.cpp.
+// bench/input_bench.cpp includes it too, with stand-ins for the SDL types and
+// functions it uses, quit, left_stick_deadzone and PlatformLog.
+
+// Keys, gamepad buttons and gamepad axes are looked up in tables indexed by
+// SDL scancode, button and axis, so each event is one load instead of a walk
+// down a chain of comparisons. Keys and buttons map to a mask of actions,
+// which lets one input drive several, gamepad start is both start and quit.
+// The tables are filled from ./bindings.txt at startup and again whenever the
+// file changes, falling back to the defaults below when it's missing. Lines
+// look like
+//   key Left Shift left_shoulder
+//   button dpup move_north
+//   axis leftx move_x
+// using SDL's scancode, gamepad button and gamepad axis names. The save slot
+// actions only fire with Alt held.
+
+typedef enum input_action {
+  // Same order as controller_input_t buttons
+  INPUT_ACTION_MOVE_NORTH,
+  INPUT_ACTION_MOVE_SOUTH,
+  INPUT_ACTION_MOVE_WEST,
+  INPUT_ACTION_MOVE_EAST,
+  INPUT_ACTION_ACTION_NORTH,
+  INPUT_ACTION_ACTION_SOUTH,
+  INPUT_ACTION_ACTION_WEST,
+  INPUT_ACTION_ACTION_EAST,
+  INPUT_ACTION_LEFT_SHOULDER,
+  INPUT_ACTION_RIGHT_SHOULDER,
+  INPUT_ACTION_START,
+  INPUT_ACTION_SELECT,
+
+  INPUT_ACTION_QUIT,
+  INPUT_ACTION_TOGGLE_RECORDING,
+  INPUT_ACTION_TOGGLE_CAPTURE,
+  INPUT_ACTION_SAVE_SLOT_0,
+  INPUT_ACTION_SAVE_SLOT_1,
+  INPUT_ACTION_SAVE_SLOT_2,
+  INPUT_ACTION_SAVE_SLOT_3,
+
+  INPUT_ACTION_COUNT,
+} input_action_t;
+
+const char *input_action_names[INPUT_ACTION_COUNT] = {
+    "move_north",       "move_south",     "move_west",   "move_east",
+    "action_north",     "action_south",   "action_west", "action_east",
+    "left_shoulder",    "right_shoulder", "start",       "select",
+    "quit",             "toggle_recording", "toggle_capture",
+    "save_slot_0",      "save_slot_1",    "save_slot_2", "save_slot_3",
+};
+
+#define INPUT_MOVE_ACTIONS                                                     \
+  ((1u << INPUT_ACTION_MOVE_NORTH) | (1u << INPUT_ACTION_MOVE_SOUTH) |         \
+   (1u << INPUT_ACTION_MOVE_WEST) | (1u << INPUT_ACTION_MOVE_EAST))
+#define INPUT_BUTTON_ACTIONS ((1u << (INPUT_ACTION_SELECT + 1)) - 1)
+
+typedef enum input_axis {
+  INPUT_AXIS_NONE,
+  INPUT_AXIS_MOVE_X,
+  INPUT_AXIS_MOVE_Y,
+
+  INPUT_AXIS_COUNT,
+} input_axis_t;
+
+const char *input_axis_names[INPUT_AXIS_COUNT] = {"none", "move_x", "move_y"};
+
+// Looked up rather than branched on, sticks send x and y interleaved so a
+// branch on the axis mispredicts about half the time
+typedef struct input_axis_target {
+  Uint32 average_offset;
+  int negative_button;
+  int positive_button;
+} input_axis_target_t;
+
+global_variable input_axis_target_t input_axis_targets[INPUT_AXIS_COUNT] = {
+    {},
+    {offsetof(controller_input_t, left_stick_average_x),
+     INPUT_ACTION_MOVE_WEST, INPUT_ACTION_MOVE_EAST},
+    {offsetof(controller_input_t, left_stick_average_y),
+     INPUT_ACTION_MOVE_NORTH, INPUT_ACTION_MOVE_SOUTH},
+};
+
+typedef struct input_bindings {
+  Uint32 keys[SDL_SCANCODE_COUNT];
+  Uint32 gamepad_buttons[SDL_GAMEPAD_BUTTON_COUNT];
+  Uint8 gamepad_axes[SDL_GAMEPAD_AXIS_COUNT];
+} input_bindings_t;
+
+global_variable input_bindings_t input_bindings;
+
+
+const char default_input_bindings[] = "key W move_north\n"
+                                      "key A move_west\n"
+                                      "key S move_south\n"
+                                      "key D move_east\n"
+                                      "key Up move_north\n"
+                                      "key Left move_west\n"
+                                      "key Down move_south\n"
+                                      "key Right move_east\n"
+                                      "key E action_south\n"
+                                      "key F action_east\n"
+                                      "key Q action_west\n"
+                                      "key R action_north\n"
+                                      "key Left Shift left_shoulder\n"
+                                      "key Left Ctrl right_shoulder\n"
+                                      "key P start\n"
+                                      "key I select\n"
+                                      "key Escape quit\n"
+                                      "key L toggle_recording\n"
+                                      "key K toggle_capture\n"
+                                      "key 7 save_slot_0\n"
+                                      "key 8 save_slot_1\n"
+                                      "key 9 save_slot_2\n"
+                                      "key 0 save_slot_3\n"
+                                      "button start start\n"
+                                      "button start quit\n"
+                                      "button back select\n"
+                                      "button leftshoulder left_shoulder\n"
+                                      "button rightshoulder right_shoulder\n"
+                                      "button x action_west\n"
+                                      "button y action_north\n"
+                                      "button a action_south\n"
+                                      "button b action_east\n"
+                                      "button dpup move_north\n"
+                                      "button dpdown move_south\n"
+                                      "button dpleft move_west\n"
+                                      "button dpright move_east\n"
+                                      "axis leftx move_x\n"
+                                      "axis lefty move_y\n";
+
+internal_fn int PlatformFindName(const char **names, int name_count,
+                                 const char *name) {
+  for (int name_i = 0; name_i < name_count; name_i++) {
+    if (strcmp(names[name_i], name) == 0) {
+      return name_i;
+    }
+  }
+  return -1;
+}
+
+// line is "<kind> <name, may have spaces> <action>" with comments and the
+// surrounding whitespace already stripped
+internal_fn bool PlatformParseInputBinding(char *line,
+                                           input_bindings_t *bindings) {
+  char *name = strchr(line, ' ');
+  char *action = strrchr(line, ' ');
+  if (name == NULL || action == name) {
+    return false;
+  }
+  *name++ = '\0';
+  *action++ = '\0';
+  while (*name == ' ') {
+    name++;
+  }
+  for (char *end = action - 1; end > name && end[-1] == ' '; end--) {
+    end[-1] = '\0';
+  }
+
+  if (strcmp(line, "axis") == 0) {
+    int axis_action = PlatformFindName(input_axis_names, INPUT_AXIS_COUNT,
+                                       action);
+    SDL_GamepadAxis axis = SDL_GetGamepadAxisFromString(name);
+    if (axis_action < 0 || axis == SDL_GAMEPAD_AXIS_INVALID) {
+      return false;
+    }
+    bindings->gamepad_axes[axis] = (Uint8)axis_action;
+    return true;
+  }
+
+  int action_idx = PlatformFindName(input_action_names, INPUT_ACTION_COUNT,
+                                    action);
+  if (action_idx < 0) {
+    return false;
+  }
+  if (strcmp(line, "key") == 0) {
+    SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+    if (scancode == SDL_SCANCODE_UNKNOWN) {
+      return false;
+    }
+    bindings->keys[scancode] |= 1u << action_idx;
+    return true;
+  }
+  if (strcmp(line, "button") == 0) {
+    SDL_GamepadButton button = SDL_GetGamepadButtonFromString(name);
+    if (button == SDL_GAMEPAD_BUTTON_INVALID) {
+      return false;
+    }
+    bindings->gamepad_buttons[button] |= 1u << action_idx;
+    return true;
+  }
+  return false;
+}
+
+// Bad lines are logged and skipped, the rest still apply
+internal_fn void PlatformParseInputBindings(const char *text, Uint32 text_size,
+                                            const char *source,
+                                            input_bindings_t *bindings) {
+  *bindings = {};
+  int line_number = 0;
+  Uint32 at = 0;
+  while (at < text_size) {
+    char line[256];
+    Uint32 line_length = 0;
+    while (at < text_size && text[at] != '\n') {
+      if (line_length < sizeof(line) - 1) {
+        line[line_length++] = text[at] == '\t' ? ' ' : text[at];
+      }
+      at++;
+    }
+    at++;
+    line_number++;
+    line[line_length] = '\0';
+
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+      line_length = comment - line;
+    }
+    while (line_length &&
+           (line[line_length - 1] == ' ' || line[line_length - 1] == '\r')) {
+      line[--line_length] = '\0';
+    }
+    char *start = line;
+    while (*start == ' ') {
+      start++;
+    }
+    if (*start == '\0') {
+      continue;
+    }
+
+    if (!PlatformParseInputBinding(start, bindings)) {
+      PlatformLog("%s:%d: unrecognised binding", source, line_number);
+    }
+  }
+}
+
+internal_fn void PlatformHandleInputButton(game_button_state_t *new_state,
+                                           bool value) {
+  new_state->ended_down = value;
+  new_state->half_transition_count++;
+}
+
+internal_fn void PlatformHandleGamepadButton(game_button_state_t *old_state,
+                                             game_button_state_t *new_state,
+                                             bool value) {
+  new_state->ended_down = value;
+  new_state->half_transition_count +=
+      ((new_state->ended_down == old_state->ended_down) ? 0 : 1);
+}
+
+internal_fn float PlatformGetGamepadAxisValue(int16_t value, int16_t deadzone) {
+  float result = 0;
+  if (value < -deadzone) {
+    result = (float)((value + deadzone) / (32768.0f - deadzone));
+  } else if (value > deadzone) {
+    result = (float)((value - deadzone) / (32767.0f - deadzone));
+  }
+  return result;
+}
+
+#define INPUT_HOTKEY_ACTIONS                                                   \
+  ((1u << INPUT_ACTION_TOGGLE_RECORDING) |                                     \
+   (1u << INPUT_ACTION_TOGGLE_CAPTURE))
+#define INPUT_SAVE_SLOT_ACTIONS (0xFu << INPUT_ACTION_SAVE_SLOT_0)
+
+// Returns the hotkey actions that went down, save slots only with Alt held,
+// for the platform to act on
+internal_fn Uint32 PlatformHandleInputActions(Uint32 actions, bool down,
+                                              bool alt_held,
+                                              game_input_t *new_input) {
+  if (actions & (1u << INPUT_ACTION_QUIT)) {
+    PlatformLog("Quit requested");
+    quit = true;
+  }
+
+  if (actions & INPUT_MOVE_ACTIONS) {
+    new_input->controller.is_analog = false;
+  }
+  Uint32 button_actions = actions & INPUT_BUTTON_ACTIONS;
+  while (button_actions) {
+    int button_i = __builtin_ctz(button_actions);
+    button_actions &= button_actions - 1;
+    PlatformHandleInputButton(&new_input->controller.buttons[button_i], down);
+  }
+
+  if (!down) {
+    return 0;
+  }
+  Uint32 hotkeys = actions & INPUT_HOTKEY_ACTIONS;
+  if (alt_held) {
+    hotkeys |= actions & INPUT_SAVE_SLOT_ACTIONS;
+  }
+  return hotkeys;
+}
+
+// Returns the hotkeys the event pressed, see PlatformHandleInputActions
+internal_fn Uint32 PlatformHandleInputEvent(SDL_Event *event,
+                                            game_input_t *new_input,
+                                            game_input_t *old_input) {
+  Uint32 hotkeys = 0;
+
+  // Mouse for debug purposes
+  // Generates multiple events per frame which is not desireable
+  // uint leftclick = (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON_LMASK);
+  // can be used to detect a mouse click
+
+  float mouseX_f;
+  float mouseY_f;
+  SDL_GetMouseState(&mouseX_f, &mouseY_f);
+  new_input->mouseX = (Uint32)mouseX_f;
+  new_input->mouseY = (Uint32)mouseY_f;
+  // new_input->mouseY = 0; // Support mouse wheel scroll?
+
+  switch (event->type) {
+  case SDL_EVENT_MOUSE_BUTTON_DOWN:
+  case SDL_EVENT_MOUSE_BUTTON_UP: {
+    if (event->button.button == SDL_BUTTON_LEFT) {
+      PlatformHandleInputButton(&new_input->left_click, event->button.down);
+    }
+    if (event->button.button == SDL_BUTTON_RIGHT) {
+      PlatformHandleInputButton(&new_input->right_click, event->button.down);
+    }
+  } break;
+
+  // Keyboard inputs
+  case SDL_EVENT_KEY_DOWN:
+  case SDL_EVENT_KEY_UP: {
+    if (event->key.scancode >= SDL_SCANCODE_COUNT) {
+      break;
+    }
+    Uint32 actions = input_bindings.keys[event->key.scancode];
+    // Held keys repeat, only quit listens to those
+    if (event->key.repeat) {
+      actions &= 1u << INPUT_ACTION_QUIT;
+    }
+    if (actions) {
+      hotkeys = PlatformHandleInputActions(actions, event->key.down,
+                                           event->key.mod & SDL_KMOD_ALT,
+                                           new_input);
+    }
+  } break;
+
+  // Gamepad inputs
+  case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+  case SDL_EVENT_GAMEPAD_BUTTON_UP: {
+    if (event->gbutton.button >= SDL_GAMEPAD_BUTTON_COUNT) {
+      break;
+    }
+    Uint32 actions = input_bindings.gamepad_buttons[event->gbutton.button];
+    if (actions) {
+      hotkeys = PlatformHandleInputActions(actions, event->gbutton.down,
+                                           false, new_input);
+    }
+  } break;
+
+  // Each stick axis only drives its own half of the movement buttons
+  case SDL_EVENT_GAMEPAD_AXIS_MOTION: {
+    if (event->gaxis.axis >= SDL_GAMEPAD_AXIS_COUNT) {
+      break;
+    }
+    Uint8 axis = input_bindings.gamepad_axes[event->gaxis.axis];
+    if (axis == INPUT_AXIS_NONE) {
+      break;
+    }
+    float threshold = 0.5f;
+    input_axis_target_t *target = &input_axis_targets[axis];
+    controller_input_t *new_controller = &new_input->controller;
+    controller_input_t *old_controller = &old_input->controller;
+    float *average =
+        (float *)((Uint8 *)new_controller + target->average_offset);
+
+    new_controller->is_analog = true;
+    *average =
+        PlatformGetGamepadAxisValue(event->gaxis.value, left_stick_deadzone);
+    PlatformHandleGamepadButton(
+        &old_controller->buttons[target->negative_button],
+        &new_controller->buttons[target->negative_button],
+        *average < -threshold);
+    PlatformHandleGamepadButton(
+        &old_controller->buttons[target->positive_button],
+        &new_controller->buttons[target->positive_button],
+        *average > threshold);
+  } break;
+  }
+  return hotkeys;
+}
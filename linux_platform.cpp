@@ -3,11 +3,22 @@
 #include <SDL3/SDL.h>
 
 #include <dlfcn.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -16,6 +27,434 @@
 // Either I will figure it out, or just use SDL later
 // without managing the buffer myself.
 
+// Logging
+
+// PlatformLog copies the format pointer and its arguments into a fixed-size
+// record on a ring owned by the calling thread and returns, a logger thread
+// drains the rings every few milliseconds, formats the records and hands the
+// text to SDL_Log, so neither the formatting nor a slow terminal costs the
+// frame. The calling thread only walks the format to pull the arguments off
+// the va_list, %s strings are copied into the record since the caller's
+// buffer may be gone by the time it's formatted, and the format itself must
+// be a string literal. Rings are single producer single consumer so neither
+// side takes a lock. When a ring is full the record is dropped and counted.
+// The logger suppresses a message whose text matches the previous one from
+// that thread within a second and reports a repeat count, stamped with the
+// last repeat's time, once the second is up, so a condition that fires every
+// frame logs once a second. A thread's
+// ring goes back to the pool when the thread exits. Before the logger starts
+// records are held on the rings, if it can't start or has shut down
+// PlatformLog goes straight to SDL_Log, as do fatal errors before exiting.
+
+#define LOG_RING_SIZE 128
+#define LOG_MAX_THREADS 16
+#define LOG_MAX_ARGS 16
+#define LOG_RECORD_STRINGS_SIZE 104
+#define LOG_TEXT_SIZE 512
+
+const Uint64 log_rate_limit_ns = 1000000000;
+const Uint32 log_drain_interval_ms = 5;
+
+// One printf argument as the logger will pass it, integers widened to 64 bits
+// and %s as an offset into the record's strings
+typedef union log_arg {
+  Uint64 u;
+  double f;
+  const void *p;
+} log_arg_t;
+
+typedef struct log_record {
+  Uint64 time_ns;
+  const char *format;
+  Uint32 arg_count;
+  Uint32 strings_used;
+  log_arg_t args[LOG_MAX_ARGS];
+  char strings[LOG_RECORD_STRINGS_SIZE];
+} log_record_t;
+
+// A conversion in a format, from its % to one past the conversion character
+typedef struct log_spec {
+  const char *start;
+  const char *length;
+  const char *end;
+  char conversion;
+  Uint32 star_count;
+  bool wide;
+  bool long_double;
+} log_spec_t;
+
+typedef enum log_ring_state {
+  LOG_RING_FREE,
+  LOG_RING_OWNED,
+  // The owning thread exited, the logger frees it once it's drained
+  LOG_RING_RELEASED,
+} log_ring_state_t;
+
+typedef struct log_ring {
+  // head is only written by the owning thread and tail by the logger
+  alignas(64) Uint32 head;
+  alignas(64) Uint32 tail;
+  Uint32 dropped;
+  Uint32 state;
+
+  // Rate limiting, only touched by the logger
+  Uint64 last_hash;
+  Uint64 last_time_ns;
+  Uint64 last_suppressed_ns;
+  Uint32 suppressed;
+
+  log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+global_variable log_ring_t log_rings[LOG_MAX_THREADS];
+global_variable Uint32 log_dropped_total;
+global_variable pthread_t log_thread;
+global_variable bool log_thread_running;
+global_variable bool log_thread_quit;
+// Set when there is no logger thread to drain the rings
+global_variable bool log_synchronous;
+global_variable pthread_key_t log_ring_key;
+global_variable pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+
+global_variable __thread log_ring_t *log_thread_ring;
+
+internal_fn void PlatformReleaseLogRing(void *ring) {
+  __atomic_store_n(&((log_ring_t *)ring)->state, LOG_RING_RELEASED,
+                   __ATOMIC_RELEASE);
+}
+
+internal_fn void PlatformCreateLogRingKey() {
+  pthread_key_create(&log_ring_key, PlatformReleaseLogRing);
+}
+
+// NULL when every ring is taken
+internal_fn log_ring_t *PlatformAcquireLogRing() {
+  pthread_once(&log_ring_key_once, PlatformCreateLogRingKey);
+  for (Uint32 ring_i = 0; ring_i < LOG_MAX_THREADS; ring_i++) {
+    log_ring_t *ring = &log_rings[ring_i];
+    Uint32 expected = LOG_RING_FREE;
+    if (__atomic_compare_exchange_n(&ring->state, &expected, LOG_RING_OWNED,
+                                    false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED)) {
+      pthread_setspecific(log_ring_key, ring);
+      return ring;
+    }
+  }
+  return NULL;
+}
+
+// Returns the next conversion at or after at, or NULL when there are no more
+internal_fn const char *PlatformNextLogSpec(const char *at, log_spec_t *spec) {
+  at = strchr(at, '%');
+  if (at == NULL) {
+    return NULL;
+  }
+  *spec = {};
+  spec->start = at++;
+  while (*at && strchr("-+ #0", *at)) {
+    at++;
+  }
+  for (int field_i = 0; field_i < 2; field_i++) {
+    // Width, then precision
+    if (field_i == 1) {
+      if (*at != '.') {
+        break;
+      }
+      at++;
+    }
+    if (*at == '*') {
+      spec->star_count++;
+      at++;
+    }
+    while (*at >= '0' && *at <= '9') {
+      at++;
+    }
+  }
+  spec->length = at;
+  while (*at && strchr("hlLqjzt", *at)) {
+    // Everything but h and hh is 64 bits here
+    spec->wide |= *at != 'h' && *at != 'L';
+    spec->long_double |= *at == 'L';
+    at++;
+  }
+  spec->conversion = *at;
+  spec->end = *at ? at + 1 : at;
+  return spec->end;
+}
+
+internal_fn void PlatformCaptureLogArgs(log_record_t *record, va_list args) {
+  record->arg_count = 0;
+  record->strings_used = 0;
+  log_spec_t spec;
+  const char *at = record->format;
+  while ((at = PlatformNextLogSpec(at, &spec)) != NULL) {
+    if (spec.conversion == '%' || spec.conversion == '\0') {
+      continue;
+    }
+    // The logger stops formatting at the first argument that didn't fit
+    if (record->arg_count + spec.star_count + 1 > LOG_MAX_ARGS) {
+      return;
+    }
+    for (Uint32 star_i = 0; star_i < spec.star_count; star_i++) {
+      record->args[record->arg_count++].u = (Uint64)(Sint64)va_arg(args, int);
+    }
+    log_arg_t *arg = &record->args[record->arg_count++];
+    switch (spec.conversion) {
+    case 'd':
+    case 'i': {
+      arg->u = spec.wide ? (Uint64)va_arg(args, long long)
+                         : (Uint64)(Sint64)va_arg(args, int);
+    } break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c': {
+      arg->u = spec.wide ? va_arg(args, unsigned long long)
+                         : va_arg(args, unsigned int);
+    } break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A': {
+      arg->f = spec.long_double ? (double)va_arg(args, long double)
+                                : va_arg(args, double);
+    } break;
+    case 's': {
+      const char *text = va_arg(args, const char *);
+      if (text == NULL) {
+        text = "(null)";
+      }
+      // Once the strings are full every later one is the last terminator
+      Uint32 space = LOG_RECORD_STRINGS_SIZE - record->strings_used;
+      if (space == 0) {
+        arg->u = LOG_RECORD_STRINGS_SIZE - 1;
+        break;
+      }
+      Uint32 length = (Uint32)SDL_min(strlen(text), (size_t)space - 1);
+      char *copy = record->strings + record->strings_used;
+      memcpy(copy, text, length);
+      copy[length] = '\0';
+      arg->u = record->strings_used;
+      record->strings_used += length + 1;
+    } break;
+    default: {
+      // %p, and %n which is never used
+      arg->p = va_arg(args, const void *);
+    } break;
+    }
+  }
+}
+
+// Runs on the logger thread, one snprintf per conversion with the length
+// modifier rewritten to match how the argument was stored
+internal_fn void PlatformFormatLogRecord(log_record_t *record, char *text,
+                                         Uint32 text_size) {
+  char *out = text;
+  char *out_end = text + text_size - 1;
+  Uint32 arg_i = 0;
+  log_spec_t spec;
+  const char *literal = record->format;
+  const char *at = record->format;
+  while ((at = PlatformNextLogSpec(at, &spec)) != NULL) {
+    Uint32 literal_length =
+        (Uint32)SDL_min(spec.start - literal, out_end - out);
+    memcpy(out, literal, literal_length);
+    out += literal_length;
+    literal = spec.end;
+    if (spec.conversion == '%' || spec.conversion == '\0') {
+      if (spec.conversion == '%' && out < out_end) {
+        *out++ = '%';
+      }
+      continue;
+    }
+    if (arg_i + spec.star_count + 1 > record->arg_count) {
+      break;
+    }
+
+    char spec_text[48];
+    Uint32 spec_length = 0;
+    for (const char *c = spec.start; c < spec.length; c++) {
+      if (*c == '*') {
+        int value = (int)record->args[arg_i++].u;
+        if (spec_length < sizeof(spec_text) - 16) {
+          spec_length +=
+              SDL_snprintf(spec_text + spec_length, 16, "%d", value);
+        }
+      } else if (spec_length < sizeof(spec_text) - 4) {
+        spec_text[spec_length++] = *c;
+      }
+    }
+    log_arg_t *arg = &record->args[arg_i++];
+    bool integer = strchr("diuxXoc", spec.conversion) != NULL;
+    if (integer && spec.conversion != 'c') {
+      spec_text[spec_length++] = 'l';
+      spec_text[spec_length++] = 'l';
+    }
+    spec_text[spec_length++] = spec.conversion;
+    spec_text[spec_length] = '\0';
+
+    int written = 0;
+    Uint32 space = (Uint32)(out_end - out) + 1;
+    if (integer) {
+      written = SDL_snprintf(out, space, spec_text, arg->u);
+    } else if (spec.conversion == 's') {
+      written = SDL_snprintf(out, space, spec_text, record->strings + arg->u);
+    } else if (strchr("fFeEgGaA", spec.conversion)) {
+      written = SDL_snprintf(out, space, spec_text, arg->f);
+    } else if (spec.conversion == 'p') {
+      written = SDL_snprintf(out, space, spec_text, arg->p);
+    }
+    out += SDL_clamp(written, 0, (int)(out_end - out));
+  }
+  if (at == NULL) {
+    Uint32 literal_length =
+        (Uint32)SDL_min(strlen(literal), (size_t)(out_end - out));
+    memcpy(out, literal, literal_length);
+    out += literal_length;
+  }
+  *out = '\0';
+}
+
+__attribute__((format(printf, 1, 2))) internal_fn void
+PlatformLog(const char *format, ...) {
+  log_ring_t *ring = log_thread_ring;
+  if (ring == NULL && !__atomic_load_n(&log_synchronous, __ATOMIC_ACQUIRE)) {
+    ring = PlatformAcquireLogRing();
+    log_thread_ring = ring;
+  }
+  if (ring == NULL || __atomic_load_n(&log_synchronous, __ATOMIC_ACQUIRE)) {
+    // Out of rings or nothing draining them, this thread logs directly
+    va_list args;
+    va_start(args, format);
+    SDL_LogMessageV(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO,
+                    format, args);
+    va_end(args);
+    return;
+  }
+
+  Uint32 head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  log_record_t *record = &ring->records[head % LOG_RING_SIZE];
+  record->time_ns = SDL_GetTicksNS();
+  record->format = format;
+  va_list args;
+  va_start(args, format);
+  PlatformCaptureLogArgs(record, args);
+  va_end(args);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// FNV-1a, only used to tell one message's text from the next
+internal_fn Uint64 PlatformHashLogText(const char *text) {
+  Uint64 hash = 14695981039346656037ull;
+  for (; *text; text++) {
+    hash = (hash ^ (Uint8)*text) * 1099511628211ull;
+  }
+  return hash;
+}
+
+internal_fn void PlatformFlushLogRepeats(log_ring_t *ring) {
+  if (ring->suppressed) {
+    SDL_Log("[%8.3f] (last message repeated %u more times)",
+            ring->last_suppressed_ns / 1000000000.0, ring->suppressed);
+    ring->suppressed = 0;
+  }
+}
+
+// Pending repeat counts are written once their second is up, or
+// unconditionally when flush_repeats is set
+internal_fn void PlatformDrainLogRings(bool flush_repeats) {
+  Uint64 now_ns = SDL_GetTicksNS();
+  Uint32 dropped = 0;
+  for (Uint32 ring_i = 0; ring_i < LOG_MAX_THREADS; ring_i++) {
+    log_ring_t *ring = &log_rings[ring_i];
+    Uint32 state = __atomic_load_n(&ring->state, __ATOMIC_ACQUIRE);
+    if (state == LOG_RING_FREE) {
+      continue;
+    }
+
+    Uint32 tail = ring->tail;
+    Uint32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+      log_record_t *record = &ring->records[tail % LOG_RING_SIZE];
+      char text[LOG_TEXT_SIZE];
+      PlatformFormatLogRecord(record, text, sizeof(text));
+      Uint64 hash = PlatformHashLogText(text);
+      if (hash == ring->last_hash &&
+          record->time_ns - ring->last_time_ns < log_rate_limit_ns) {
+        ring->suppressed++;
+        ring->last_suppressed_ns = record->time_ns;
+      } else {
+        PlatformFlushLogRepeats(ring);
+        SDL_Log("[%8.3f] %s", record->time_ns / 1000000000.0, text);
+        ring->last_hash = hash;
+        ring->last_time_ns = record->time_ns;
+      }
+      tail++;
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    dropped += __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+
+    if (flush_repeats || state == LOG_RING_RELEASED ||
+        now_ns - ring->last_time_ns >= log_rate_limit_ns) {
+      PlatformFlushLogRepeats(ring);
+    }
+    // The owner stored RELEASED after its last push, so the ring is empty
+    if (state == LOG_RING_RELEASED) {
+      ring->last_hash = 0;
+      ring->last_time_ns = 0;
+      __atomic_store_n(&ring->state, LOG_RING_FREE, __ATOMIC_RELEASE);
+    }
+  }
+  if (dropped) {
+    log_dropped_total += dropped;
+    SDL_Log("Dropped %u log records (%u total)", dropped, log_dropped_total);
+  }
+}
+
+internal_fn void *PlatformLogThread(void *arg) {
+  while (!__atomic_load_n(&log_thread_quit, __ATOMIC_ACQUIRE)) {
+    PlatformDrainLogRings(false);
+    SDL_Delay(log_drain_interval_ms);
+  }
+  PlatformDrainLogRings(true);
+  return NULL;
+}
+
+// Records logged before this are kept until the thread starts
+internal_fn void PlatformInitLogging() {
+  log_thread_running =
+      pthread_create(&log_thread, NULL, PlatformLogThread, NULL) == 0;
+  if (!log_thread_running) {
+    PlatformDrainLogRings(true);
+    __atomic_store_n(&log_synchronous, true, __ATOMIC_RELEASE);
+    SDL_Log("Unable to start the logging thread, logging synchronously");
+  }
+}
+
+// Flushes everything still queued, called after the other threads are done,
+// anything logged afterwards goes straight to SDL_Log
+internal_fn void PlatformShutdownLogging() {
+  if (log_thread_running) {
+    __atomic_store_n(&log_thread_quit, true, __ATOMIC_RELEASE);
+    pthread_join(log_thread, NULL);
+    log_thread_running = false;
+  } else {
+    PlatformDrainLogRings(true);
+  }
+  __atomic_store_n(&log_synchronous, true, __ATOMIC_RELEASE);
+}
+
+// end Logging
+
 #if STATIC_WHOLE_COMPILE
 
 #include "lib/game.cpp"
@@ -39,6 +478,7 @@ internal_fn void PlatformLoadGameCodeLib() {
   if (!game_lib_handle) {
     fputs(dlerror(), stderr);
     SDL_Log(" line %d", __LINE__);
+    PlatformShutdownLogging();
     exit(1);
   }
 
@@ -47,6 +487,7 @@ internal_fn void PlatformLoadGameCodeLib() {
   if ((error = dlerror()) != NULL) {
     fputs(error, stderr);
     SDL_Log(" line %d", __LINE__);
+    PlatformShutdownLogging();
     exit(1);
   }
 
@@ -54,7 +495,7 @@ internal_fn void PlatformLoadGameCodeLib() {
   stat(game_lib_name, &attr);
   prev_st_mtime = attr.st_mtime;
 
-  SDL_Log("Loaded game code from shared object");
+  PlatformLog("Loaded game code from shared object");
 }
 
 internal_fn void PlatformReloadGameCodeLib() {
@@ -149,8 +590,1047 @@ bool DEBUGPlatformWriteEntireFile(char *filename, Uint32 memory_size,
 
 // End File IO
 
+// Checksums
+
+// CRC32C, using the SSE4.2 crc32 instruction when the CPU has it
+
+global_variable Uint32 crc32c_table[256];
+global_variable bool crc32c_hardware;
+
+#if defined(__x86_64__)
+
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2"))) internal_fn Uint32
+PlatformCRC32CHardware(Uint32 crc, Uint8 *data, Uint64 size) {
+  Uint64 crc64 = crc;
+  while (size >= 8) {
+    Uint64 word;
+    memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    size -= 8;
+  }
+  Uint32 result = (Uint32)crc64;
+  while (size--) {
+    result = _mm_crc32_u8(result, *data++);
+  }
+  return result;
+}
+
+#endif
+
+internal_fn Uint32 PlatformCRC32C(Uint32 crc, Uint8 *data, Uint64 size) {
+#if defined(__x86_64__)
+  if (crc32c_hardware) {
+    return PlatformCRC32CHardware(crc, data, size);
+  }
+#endif
+  while (size--) {
+    crc = crc32c_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+internal_fn void PlatformInitCRC32C() {
+  for (Uint32 i = 0; i < 256; i++) {
+    Uint32 crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+    }
+    crc32c_table[i] = crc;
+  }
+
+#if defined(__x86_64__)
+  crc32c_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+internal_fn bool PlatformMemoryIsZero(Uint8 *memory, Uint64 size) {
+  Uint64 *words = (Uint64 *)memory;
+  for (Uint64 i = 0; i < size / sizeof(Uint64); i++) {
+    if (words[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// end Checksums
+
+// Page population
+
+// mincore only reports pages that are in RAM, so a page that was swapped out
+// looks the same as one that was never touched. /proc/self/pagemap reports
+// present and swapped separately, a page that is neither has never been
+// written, or was released, and reads as zero.
+
+#define PAGEMAP_PRESENT (1ull << 63)
+#define PAGEMAP_SWAPPED (1ull << 62)
+
+global_variable int pagemap_file_descriptor = -1;
+global_variable Uint64 pagemap_page_size;
+
+internal_fn void PlatformInitPagemap() {
+  pagemap_page_size = sysconf(_SC_PAGESIZE);
+  pagemap_file_descriptor = open("/proc/self/pagemap", O_RDONLY);
+  if (pagemap_file_descriptor == -1) {
+    PlatformLog("Unable to open /proc/self/pagemap, every page is checked");
+  }
+}
+
+// Sets populated[i] for each page of the page aligned range that is present
+// or swapped. False if pagemap can't be read, then every page has to be
+// treated as populated
+internal_fn bool PlatformReadPopulatedPages(void *base, Uint64 size,
+                                            Uint8 *populated) {
+  if (pagemap_file_descriptor == -1) {
+    return false;
+  }
+  Uint64 first_page = (Uint64)base / pagemap_page_size;
+  Uint64 page_count = (size + pagemap_page_size - 1) / pagemap_page_size;
+  Uint64 entries[512];
+  for (Uint64 page_i = 0; page_i < page_count;
+       page_i += array_length(entries)) {
+    Uint64 batch = SDL_min(page_count - page_i, array_length(entries));
+    Uint64 batch_bytes = batch * sizeof(Uint64);
+    if (pread(pagemap_file_descriptor, entries, batch_bytes,
+              (first_page + page_i) * sizeof(Uint64)) != (ssize_t)batch_bytes) {
+      return false;
+    }
+    for (Uint64 entry_i = 0; entry_i < batch; entry_i++) {
+      populated[page_i + entry_i] =
+          (entries[entry_i] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+    }
+  }
+  return true;
+}
+
+// end Page population
+
+// State hashing
+
+// Playback assumes game_update_and_render is deterministic, so in development
+// builds the permanent storage is hashed after every recorded or replayed
+// frame and the hash is kept next to the input. Pages the game has never
+// touched are still zero, so pagemap lets us skip them and a mostly empty
+// 64MB block only costs a few pages of CRC32C. Populated pages that are all
+// zero are skipped too, so the hash doesn't depend on which pages exist, a
+// restored snapshot can fault in pages the recording never touched.
+
+#if IN_DEVELOPMENT
+
+global_variable bool state_hashing_enabled = true;
+
+global_variable Uint64 state_hash_page_size;
+global_variable Uint8 *state_hash_populated;
+
+internal_fn void PlatformInitStateHashing(game_memory_t *memory) {
+  state_hash_page_size = sysconf(_SC_PAGESIZE);
+  state_hash_populated = (Uint8 *)malloc(
+      (memory->permanent_storage_size + state_hash_page_size - 1) /
+      state_hash_page_size);
+  if (state_hash_populated == NULL) {
+    PlatformLog("Unable to allocate state hash page map, hashing disabled");
+    state_hashing_enabled = false;
+  }
+}
+
+internal_fn Uint32 PlatformHashGameState(game_memory_t *memory) {
+  Uint64 page_count =
+      (memory->permanent_storage_size + state_hash_page_size - 1) /
+      state_hash_page_size;
+  Uint8 *base = (Uint8 *)memory->permanent_storage;
+
+  // If pagemap can't be read fall back to hashing everything
+  bool have_populated = PlatformReadPopulatedPages(
+      base, memory->permanent_storage_size, state_hash_populated);
+
+  Uint32 crc = 0xFFFFFFFF;
+  for (Uint64 page_i = 0; page_i < page_count; page_i++) {
+    if (have_populated && !state_hash_populated[page_i]) {
+      continue;
+    }
+    Uint8 *page = base + page_i * state_hash_page_size;
+    if (PlatformMemoryIsZero(page, state_hash_page_size)) {
+      continue;
+    }
+    // Mix in the page index so data moving between pages changes the hash
+    crc = PlatformCRC32C(crc, (Uint8 *)&page_i, sizeof(page_i));
+    crc = PlatformCRC32C(crc, page, state_hash_page_size);
+  }
+  return ~crc;
+}
+
+#endif
+
+// end State hashing
+
+// Frame capture
+
+// Press K to dump every frame the game produces to ./tmp/capture_N.rgba for
+// offline diffing, where N is the save state slot. Pressed during playback
+// the capture waits for the next loop and stops at the one after, so it holds
+// exactly one pass of the recording. The simulation thread copies each frame
+// into a preallocated pool and a writer thread drains it with O_DIRECT so a
+// long run doesn't churn the page cache. When the writer falls behind and the
+// pool is full frames are dropped rather than stalling the frame. The frames
+// are raw SDL_PIXELFORMAT_RGBA8888, which is abgr in memory, e.g.
+// ffmpeg -f rawvideo -pix_fmt abgr -s 768x432 -r 60 -i tmp/capture_0.rgba
+
+#if IN_DEVELOPMENT
+
+#define CAPTURE_POOL_SIZE 8
+
+typedef enum capture_mode {
+  CAPTURE_OFF,
+  CAPTURE_ON,
+  CAPTURE_ARMED_FOR_PLAYBACK,
+  CAPTURE_PLAYBACK,
+} capture_mode_t;
+
+typedef struct frame_capture {
+  // CAPTURE_POOL_SIZE frames, page aligned for O_DIRECT
+  Uint8 *pool;
+  Uint32 frame_size;
+
+  // head is only written by the simulation thread and tail by the writer
+  alignas(64) Uint32 head;
+  alignas(64) Uint32 tail;
+
+  sem_t frames_ready;
+  pthread_t writer;
+  int file_descriptor;
+  bool write_failed;
+
+  // Only changed on the main thread while the simulation thread is idle
+  capture_mode_t mode;
+  bool active;
+
+  Uint32 frames_captured;
+  Uint32 frames_dropped;
+  Uint64 bytes_written;
+  Uint64 start_ns;
+} frame_capture_t;
+
+global_variable frame_capture_t frame_capture;
+
+const char *capture_filename_format = "./tmp/capture_%d.rgba";
+
+// Clears O_DIRECT, after which the rest of the capture goes through the page
+// cache. False if it wasn't set
+internal_fn bool PlatformCaptureDropDirect(frame_capture_t *capture,
+                                           const char *reason) {
+  int flags = fcntl(capture->file_descriptor, F_GETFL);
+  if (flags == -1 || !(flags & O_DIRECT) ||
+      fcntl(capture->file_descriptor, F_SETFL, flags & ~O_DIRECT) == -1) {
+    return false;
+  }
+  PlatformLog("Capture writing through the page cache, %s", reason);
+  return true;
+}
+
+internal_fn bool PlatformWriteCaptureFrame(frame_capture_t *capture,
+                                           Uint8 *frame) {
+  Uint32 bytes_to_write = capture->frame_size;
+  while (bytes_to_write) {
+    ssize_t bytes_written =
+        write(capture->file_descriptor, frame, bytes_to_write);
+    if (bytes_written == -1) {
+      int write_errno = errno;
+      if (write_errno == EINTR) {
+        continue;
+      }
+      // Not every filesystem takes O_DIRECT, carry on through the page cache
+      if (write_errno == EINVAL &&
+          PlatformCaptureDropDirect(capture, "O_DIRECT was refused")) {
+        continue;
+      }
+      return false;
+    }
+    bytes_to_write -= bytes_written;
+    frame += bytes_written;
+    // A short write leaves the buffer and file offset unaligned, which
+    // O_DIRECT won't take for the remainder or any frame after it
+    if (bytes_to_write) {
+      PlatformCaptureDropDirect(capture, "after a short write");
+    }
+  }
+  return true;
+}
+
+internal_fn void *PlatformCaptureWriterThread(void *arg) {
+  frame_capture_t *capture = (frame_capture_t *)arg;
+
+  for (;;) {
+    while (sem_wait(&capture->frames_ready) == -1) {
+      // Interrupted by a signal
+    }
+
+    Uint32 tail = capture->tail;
+    Uint32 head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+      Uint8 *frame = capture->pool + (Uint64)(tail % CAPTURE_POOL_SIZE) *
+                                         capture->frame_size;
+      if (!capture->write_failed) {
+        if (PlatformWriteCaptureFrame(capture, frame)) {
+          capture->bytes_written += capture->frame_size;
+        } else {
+          capture->write_failed = true;
+        }
+      }
+      tail++;
+      __atomic_store_n(&capture->tail, tail, __ATOMIC_RELEASE);
+    }
+  }
+  return NULL;
+}
+
+// Simulation thread side, called with the frame the game just finished
+internal_fn void PlatformCaptureFrame(frame_capture_t *capture,
+                                      offscreen_buffer *buffer) {
+  if (!capture->active) {
+    return;
+  }
+
+  Uint32 head = capture->head;
+  if (head - __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE) >=
+      CAPTURE_POOL_SIZE) {
+    capture->frames_dropped++;
+    return;
+  }
+
+  memcpy(capture->pool + (Uint64)(head % CAPTURE_POOL_SIZE) *
+                             capture->frame_size,
+         buffer->buffer, capture->frame_size);
+  __atomic_store_n(&capture->head, head + 1, __ATOMIC_RELEASE);
+  capture->frames_captured++;
+  sem_post(&capture->frames_ready);
+}
+
+internal_fn void PlatformStartCapture(frame_capture_t *capture,
+                                      int capture_idx) {
+  if (capture->pool == NULL) {
+    capture->frame_size = WIDTH * HEIGHT * BYTES_PER_PX;
+    capture->pool = (Uint8 *)aligned_alloc(
+        4096, (Uint64)capture->frame_size * CAPTURE_POOL_SIZE);
+    if (capture->pool == NULL ||
+        sem_init(&capture->frames_ready, 0, 0) == -1 ||
+        pthread_create(&capture->writer, NULL, PlatformCaptureWriterThread,
+                       capture) != 0) {
+      PlatformLog("Failed to start the capture writer");
+      free(capture->pool);
+      capture->pool = NULL;
+      return;
+    }
+  }
+
+  int namesize = 32;
+  char name[namesize];
+  SDL_snprintf(name, namesize, capture_filename_format, capture_idx);
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  capture->file_descriptor = open(name, flags | O_DIRECT, mode);
+  if (capture->file_descriptor == -1) {
+    capture->file_descriptor = open(name, flags, mode);
+  }
+  if (capture->file_descriptor == -1) {
+    PlatformLog("Failed to open %s for capture", name);
+    return;
+  }
+
+  capture->write_failed = false;
+  capture->frames_captured = 0;
+  capture->frames_dropped = 0;
+  capture->bytes_written = 0;
+  capture->start_ns = SDL_GetTicksNS();
+  capture->active = true;
+  PlatformLog("Capturing frames to %s", name);
+}
+
+// Waits for the writer to drain the pool, this is the only place the frame
+// waits on the disk and only once per capture
+internal_fn void PlatformStopCapture(frame_capture_t *capture) {
+  capture->mode = CAPTURE_OFF;
+  if (!capture->active) {
+    return;
+  }
+  capture->active = false;
+
+  while (__atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE) != capture->head) {
+    SDL_Delay(1);
+  }
+  close(capture->file_descriptor);
+
+  Uint64 elapsed_ns = SDL_GetTicksNS() - capture->start_ns;
+  float megabytes = capture->bytes_written / (1024.0f * 1024.0f);
+  PlatformLog("Captured %u frames (%u dropped), %.1fMB at %.1fMB/s%s",
+              capture->frames_captured, capture->frames_dropped, megabytes,
+              elapsed_ns ? megabytes / (elapsed_ns / 1000000000.0f) : 0.0f,
+              capture->write_failed ? ", write failed" : "");
+}
+
+internal_fn void PlatformToggleCapture(frame_capture_t *capture, bool playing,
+                                       int capture_idx) {
+  if (capture->mode != CAPTURE_OFF) {
+    PlatformStopCapture(capture);
+  } else if (playing) {
+    capture->mode = CAPTURE_ARMED_FOR_PLAYBACK;
+    PlatformLog("Capture will start when playback loops");
+  } else {
+    capture->mode = CAPTURE_ON;
+    PlatformStartCapture(capture, capture_idx);
+  }
+}
+
+// Called each time playback restarts from the recorded memory block
+internal_fn void PlatformCapturePlaybackLooped(frame_capture_t *capture,
+                                               int capture_idx) {
+  if (capture->mode == CAPTURE_ARMED_FOR_PLAYBACK) {
+    capture->mode = CAPTURE_PLAYBACK;
+    PlatformStartCapture(capture, capture_idx);
+  } else if (capture->mode == CAPTURE_PLAYBACK) {
+    PlatformStopCapture(capture);
+  }
+}
+
+#endif
+
+// end Frame capture
+
+// Snapshots
+
+// Save states are a chunked snapshot of the game memory block. Chunks that
+// are all zero, which is nearly all of the transient storage, are only
+// recorded in the index. The rest are compressed with a small LZ4 style
+// codec and carry a CRC32C of their uncompressed contents, so a slot on disk
+// is roughly the size of the live data. The file is a snapshot_header_t, the
+// index of chunk_count snapshot_chunk_t and then the chunk data in whatever
+// order the compressing threads finished it.
+//
+// Writing forks a child process, which sees the memory block as it was at
+// the fork through copy on write and compresses and writes it on its own
+// threads. The frame only pays for the fork, which copies page tables rather
+// than pages, and then one page fault for each page the game writes while the
+// child still shares it. A thread in the parent waits for the child and logs
+// the result, the child can't use the log rings. Restoring decompresses
+// straight into the game memory block on several threads and hands zero
+// chunks back to the OS with MADV_DONTNEED.
+
+#define SNAPSHOT_MAGIC 0x53534848 // HHSS
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_CHUNK_SIZE Megabytes(1)
+#define SNAPSHOT_MAX_THREADS 16
+
+#define SNAPSHOT_LZ_HASH_BITS 14
+#define SNAPSHOT_LZ_MIN_MATCH 4
+#define SNAPSHOT_LZ_MAX_OFFSET 0xFFFF
+
+typedef struct snapshot_header {
+  Uint32 magic;
+  Uint32 version;
+  Uint64 memory_size;
+  Uint32 chunk_size;
+  Uint32 chunk_count;
+} snapshot_header_t;
+
+// stored_size is 0 for a zero chunk and the chunk size when it didn't
+// compress and was stored raw
+typedef struct snapshot_chunk {
+  Uint64 offset;
+  Uint32 stored_size;
+  Uint32 checksum;
+} snapshot_chunk_t;
+
+typedef struct snapshot_job {
+  int file_descriptor;
+  Uint8 *memory;
+  Uint64 memory_size;
+  Uint32 chunk_count;
+  snapshot_chunk_t *index;
+
+  // Writing only, each populated chunk of memory or NULL
+  Uint8 **chunk_data;
+  Uint64 live_size;
+
+  // Shared between the job's threads
+  Uint32 next_chunk;
+  Uint64 next_offset;
+  bool failed;
+} snapshot_job_t;
+
+internal_fn Uint32 PlatformLZRead32(Uint8 *at) {
+  Uint32 result;
+  memcpy(&result, at, sizeof(result));
+  return result;
+}
+
+// Lengths past the 4 bits in the token continue in bytes of 255
+internal_fn Uint8 *PlatformLZWriteLength(Uint8 *out, Uint8 *out_end,
+                                         Uint64 length) {
+  while (length >= 255) {
+    if (out >= out_end) {
+      return NULL;
+    }
+    *out++ = 255;
+    length -= 255;
+  }
+  if (out >= out_end) {
+    return NULL;
+  }
+  *out++ = (Uint8)length;
+  return out;
+}
+
+// Emits one sequence of literals followed by a match, a match_length of 0 is
+// the last sequence which only has literals
+internal_fn Uint8 *PlatformLZWriteSequence(Uint8 *out, Uint8 *out_end,
+                                           Uint8 *literals,
+                                           Uint64 literal_length,
+                                           Uint64 offset,
+                                           Uint64 match_length) {
+  if (out >= out_end) {
+    return NULL;
+  }
+  Uint64 extra_match = match_length ? match_length - SNAPSHOT_LZ_MIN_MATCH : 0;
+  Uint8 *token = out++;
+  *token = (Uint8)((SDL_min(literal_length, 15) << 4) |
+                   SDL_min(extra_match, 15));
+
+  if (literal_length >= 15) {
+    out = PlatformLZWriteLength(out, out_end, literal_length - 15);
+    if (!out) {
+      return NULL;
+    }
+  }
+  if ((Uint64)(out_end - out) < literal_length) {
+    return NULL;
+  }
+  memcpy(out, literals, literal_length);
+  out += literal_length;
+
+  if (match_length) {
+    if (out_end - out < 2) {
+      return NULL;
+    }
+    *out++ = (Uint8)(offset & 0xFF);
+    *out++ = (Uint8)(offset >> 8);
+    if (extra_match >= 15) {
+      out = PlatformLZWriteLength(out, out_end, extra_match - 15);
+    }
+  }
+  return out;
+}
+
+// Returns 0 when the result doesn't fit in dst_capacity
+internal_fn Uint64 PlatformLZCompress(Uint8 *src, Uint64 src_size, Uint8 *dst,
+                                      Uint64 dst_capacity) {
+  Uint32 table[1 << SNAPSHOT_LZ_HASH_BITS] = {};
+  Uint8 *out = dst;
+  Uint8 *out_end = dst + dst_capacity;
+
+  // The tail is always literals, which keeps the 4 byte reads in bounds
+  Uint64 match_limit = src_size > 12 ? src_size - 12 : 0;
+  Uint64 anchor = 0;
+  Uint64 pos = 0;
+  Uint32 misses = 0;
+
+  while (pos < match_limit) {
+    Uint32 sequence = PlatformLZRead32(src + pos);
+    Uint32 hash = (sequence * 2654435761u) >> (32 - SNAPSHOT_LZ_HASH_BITS);
+    Uint64 candidate = table[hash];
+    table[hash] = (Uint32)pos;
+
+    if (candidate < pos && pos - candidate <= SNAPSHOT_LZ_MAX_OFFSET &&
+        PlatformLZRead32(src + candidate) == sequence) {
+      Uint64 match_length = SNAPSHOT_LZ_MIN_MATCH;
+      while (pos + match_length < src_size &&
+             src[candidate + match_length] == src[pos + match_length]) {
+        match_length++;
+      }
+      out = PlatformLZWriteSequence(out, out_end, src + anchor, pos - anchor,
+                                    pos - candidate, match_length);
+      if (!out) {
+        return 0;
+      }
+      pos += match_length;
+      anchor = pos;
+      misses = 0;
+    } else {
+      // Skip ahead faster through data that doesn't compress
+      pos += 1 + (misses++ >> 5);
+    }
+  }
+
+  out = PlatformLZWriteSequence(out, out_end, src + anchor, src_size - anchor,
+                                0, 0);
+  return out ? out - dst : 0;
+}
+
+// Bounds checked so a corrupt chunk fails rather than scribbling on memory
+internal_fn bool PlatformLZDecompress(Uint8 *src, Uint64 src_size, Uint8 *dst,
+                                      Uint64 dst_size) {
+  Uint8 *in = src;
+  Uint8 *in_end = src + src_size;
+  Uint8 *out = dst;
+  Uint8 *out_end = dst + dst_size;
+
+  while (in < in_end) {
+    Uint8 token = *in++;
+
+    Uint64 literal_length = token >> 4;
+    if (literal_length == 15) {
+      Uint8 extra;
+      do {
+        if (in >= in_end) {
+          return false;
+        }
+        extra = *in++;
+        literal_length += extra;
+      } while (extra == 255);
+    }
+    if ((Uint64)(in_end - in) < literal_length ||
+        (Uint64)(out_end - out) < literal_length) {
+      return false;
+    }
+    memcpy(out, in, literal_length);
+    in += literal_length;
+    out += literal_length;
+
+    if (in == in_end) {
+      break;
+    }
+
+    if (in_end - in < 2) {
+      return false;
+    }
+    Uint64 offset = in[0] | (in[1] << 8);
+    in += 2;
+    if (offset == 0 || offset > (Uint64)(out - dst)) {
+      return false;
+    }
+
+    Uint64 match_length = token & 0xF;
+    if (match_length == 15) {
+      Uint8 extra;
+      do {
+        if (in >= in_end) {
+          return false;
+        }
+        extra = *in++;
+        match_length += extra;
+      } while (extra == 255);
+    }
+    match_length += SNAPSHOT_LZ_MIN_MATCH;
+    if ((Uint64)(out_end - out) < match_length) {
+      return false;
+    }
+
+    Uint8 *match = out - offset;
+    if (offset >= match_length) {
+      memcpy(out, match, match_length);
+      out += match_length;
+    } else {
+      // Overlapping matches repeat the bytes just written
+      while (match_length--) {
+        *out++ = *match++;
+      }
+    }
+  }
+
+  return out == out_end;
+}
+
+internal_fn bool PlatformPWriteAll(int file_descriptor, Uint8 *data,
+                                   Uint64 size, Uint64 offset) {
+  while (size) {
+    ssize_t written = pwrite(file_descriptor, data, size, offset);
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+internal_fn bool PlatformPReadAll(int file_descriptor, Uint8 *data,
+                                  Uint64 size, Uint64 offset) {
+  while (size) {
+    ssize_t bytes_read = pread(file_descriptor, data, size, offset);
+    if (bytes_read <= 0) {
+      return false;
+    }
+    data += bytes_read;
+    size -= bytes_read;
+    offset += bytes_read;
+  }
+  return true;
+}
+
+internal_fn Uint64 PlatformSnapshotChunkSize(snapshot_job_t *job,
+                                             Uint32 chunk_i) {
+  Uint64 start = (Uint64)chunk_i * SNAPSHOT_CHUNK_SIZE;
+  return SDL_min(SNAPSHOT_CHUNK_SIZE, job->memory_size - start);
+}
+
+internal_fn void *PlatformSnapshotCompressThread(void *arg) {
+  snapshot_job_t *job = (snapshot_job_t *)arg;
+  Uint8 *compressed = (Uint8 *)malloc(SNAPSHOT_CHUNK_SIZE);
+  if (compressed == NULL) {
+    job->failed = true;
+    return NULL;
+  }
+
+  for (;;) {
+    Uint32 chunk_i = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk_i >= job->chunk_count) {
+      break;
+    }
+    snapshot_chunk_t *chunk = &job->index[chunk_i];
+    Uint8 *data = job->chunk_data[chunk_i];
+    Uint64 size = PlatformSnapshotChunkSize(job, chunk_i);
+
+    if (data == NULL || PlatformMemoryIsZero(data, size)) {
+      *chunk = {};
+      continue;
+    }
+
+    chunk->checksum = ~PlatformCRC32C(0xFFFFFFFF, data, size);
+
+    // One byte short of raw so a compressed chunk can't look stored
+    Uint64 stored_size = PlatformLZCompress(data, size, compressed, size - 1);
+    Uint8 *stored = compressed;
+    if (stored_size == 0) {
+      stored_size = size;
+      stored = data;
+    }
+    chunk->stored_size = (Uint32)stored_size;
+    chunk->offset =
+        __atomic_fetch_add(&job->next_offset, stored_size, __ATOMIC_RELAXED);
+    if (!PlatformPWriteAll(job->file_descriptor, stored, stored_size,
+                           chunk->offset)) {
+      job->failed = true;
+    }
+  }
+
+  free(compressed);
+  return NULL;
+}
+
+internal_fn void *PlatformSnapshotRestoreThread(void *arg) {
+  snapshot_job_t *job = (snapshot_job_t *)arg;
+  Uint8 *compressed = (Uint8 *)malloc(SNAPSHOT_CHUNK_SIZE);
+  if (compressed == NULL) {
+    job->failed = true;
+    return NULL;
+  }
+
+  for (;;) {
+    Uint32 chunk_i = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk_i >= job->chunk_count) {
+      break;
+    }
+    snapshot_chunk_t *chunk = &job->index[chunk_i];
+    Uint8 *target = job->memory + (Uint64)chunk_i * SNAPSHOT_CHUNK_SIZE;
+    Uint64 size = PlatformSnapshotChunkSize(job, chunk_i);
+
+    if (chunk->stored_size == 0) {
+      // Reads back as zero and gives the pages back
+      madvise(target, size, MADV_DONTNEED);
+      continue;
+    }
+
+    bool restored = false;
+    if (chunk->stored_size == size) {
+      restored =
+          PlatformPReadAll(job->file_descriptor, target, size, chunk->offset);
+    } else if (chunk->stored_size < size) {
+      restored = PlatformPReadAll(job->file_descriptor, compressed,
+                                  chunk->stored_size, chunk->offset) &&
+                 PlatformLZDecompress(compressed, chunk->stored_size, target,
+                                      size);
+    }
+    if (!restored ||
+        ~PlatformCRC32C(0xFFFFFFFF, target, size) != chunk->checksum) {
+      PlatformLog("Snapshot chunk %u is corrupt", chunk_i);
+      job->failed = true;
+    }
+  }
+
+  free(compressed);
+  return NULL;
+}
+
+// Runs thread_fn on one thread per core, including the calling one
+internal_fn void PlatformRunSnapshotThreads(snapshot_job_t *job,
+                                            void *(*thread_fn)(void *)) {
+  pthread_t threads[SNAPSHOT_MAX_THREADS];
+  int thread_count =
+      SDL_clamp((int)sysconf(_SC_NPROCESSORS_ONLN), 1, SNAPSHOT_MAX_THREADS);
+  int started = 0;
+  for (int thread_i = 1; thread_i < thread_count; thread_i++) {
+    if (pthread_create(&threads[started], NULL, thread_fn, job) == 0) {
+      started++;
+    }
+  }
+  thread_fn(job);
+  for (int thread_i = 0; thread_i < started; thread_i++) {
+    pthread_join(threads[thread_i], NULL);
+  }
+}
+
+internal_fn void PlatformFreeSnapshotJob(snapshot_job_t *job) {
+  if (job->file_descriptor != -1) {
+    close(job->file_descriptor);
+  }
+  free(job->index);
+  free(job->chunk_data);
+  free(job);
+}
+
+// Sent up a pipe from the writing child
+typedef struct snapshot_result {
+  bool written;
+  Uint64 live_size;
+  Uint64 file_size;
+} snapshot_result_t;
+
+typedef struct snapshot_child {
+  pid_t pid;
+  int result_pipe;
+  Uint64 start_ns;
+} snapshot_child_t;
+
+// Runs in the forked child, which only has this thread and must not log.
+// Chunks with no present or swapped pages have never been touched, or were
+// released, and are zero
+internal_fn snapshot_result_t PlatformWriteSnapshot(int file_descriptor,
+                                                    Uint8 *memory,
+                                                    Uint64 memory_size) {
+  snapshot_result_t result = {};
+  snapshot_job_t *job = (snapshot_job_t *)calloc(1, sizeof(snapshot_job_t));
+  if (job == NULL || ftruncate(file_descriptor, 0) == -1) {
+    free(job);
+    return result;
+  }
+  job->file_descriptor = file_descriptor;
+  job->memory = memory;
+  job->memory_size = memory_size;
+  job->chunk_count =
+      (memory_size + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+  job->index =
+      (snapshot_chunk_t *)calloc(job->chunk_count, sizeof(snapshot_chunk_t));
+  job->chunk_data = (Uint8 **)calloc(job->chunk_count, sizeof(Uint8 *));
+
+  // The inherited descriptor still reads the parent's pagemap, which moves
+  // on from the fork
+  if (pagemap_file_descriptor != -1) {
+    close(pagemap_file_descriptor);
+    pagemap_file_descriptor = open("/proc/self/pagemap", O_RDONLY);
+  }
+  Uint64 page_size = sysconf(_SC_PAGESIZE);
+  Uint64 pages_per_chunk = SNAPSHOT_CHUNK_SIZE / page_size;
+  Uint8 *populated = (Uint8 *)malloc((memory_size + page_size - 1) / page_size);
+
+  if (job->index == NULL || job->chunk_data == NULL || populated == NULL) {
+    free(populated);
+    PlatformFreeSnapshotJob(job);
+    return result;
+  }
+
+  // Without pagemap every chunk is compressed
+  bool have_populated =
+      PlatformReadPopulatedPages(memory, memory_size, populated);
+  for (Uint32 chunk_i = 0; chunk_i < job->chunk_count; chunk_i++) {
+    bool chunk_has_pages = !have_populated;
+    Uint64 first_page = (Uint64)chunk_i * pages_per_chunk;
+    Uint64 chunk_size = PlatformSnapshotChunkSize(job, chunk_i);
+    Uint64 page_count = (chunk_size + page_size - 1) / page_size;
+    for (Uint64 page_i = 0; page_i < page_count && !chunk_has_pages;
+         page_i++) {
+      chunk_has_pages = populated[first_page + page_i];
+    }
+    if (chunk_has_pages) {
+      job->chunk_data[chunk_i] =
+          memory + (Uint64)chunk_i * SNAPSHOT_CHUNK_SIZE;
+      job->live_size += chunk_size;
+    }
+  }
+  free(populated);
+
+  job->next_offset =
+      sizeof(snapshot_header_t) + job->chunk_count * sizeof(snapshot_chunk_t);
+  PlatformRunSnapshotThreads(job, PlatformSnapshotCompressThread);
+
+  snapshot_header_t header = {};
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.memory_size = job->memory_size;
+  header.chunk_size = SNAPSHOT_CHUNK_SIZE;
+  header.chunk_count = job->chunk_count;
+
+  // The header goes last so a snapshot cut short never looks valid
+  result.written =
+      !job->failed &&
+      PlatformPWriteAll(job->file_descriptor, (Uint8 *)job->index,
+                        job->chunk_count * sizeof(snapshot_chunk_t),
+                        sizeof(header)) &&
+      PlatformPWriteAll(job->file_descriptor, (Uint8 *)&header,
+                        sizeof(header), 0);
+  result.live_size = job->live_size;
+  result.file_size = job->next_offset;
+
+  PlatformFreeSnapshotJob(job);
+  return result;
+}
+
+internal_fn void *PlatformSnapshotWriterThread(void *arg) {
+  snapshot_child_t *child = (snapshot_child_t *)arg;
+
+  snapshot_result_t result = {};
+  ssize_t bytes_read;
+  do {
+    bytes_read = read(child->result_pipe, &result, sizeof(result));
+  } while (bytes_read == -1 && errno == EINTR);
+  close(child->result_pipe);
+  while (waitpid(child->pid, NULL, 0) == -1 && errno == EINTR) {
+  }
+
+  // A child that died early closed the pipe without a result
+  if (bytes_read != (ssize_t)sizeof(result) || !result.written) {
+    PlatformLog("Failed to write snapshot");
+  } else {
+    PlatformLog("Wrote snapshot, %luMB live compressed to %luMB in %lums",
+                (Uint64)(result.live_size / Megabytes(1)),
+                (Uint64)(result.file_size / Megabytes(1)),
+                (SDL_GetTicksNS() - child->start_ns) / 1000000);
+  }
+
+  free(child);
+  return NULL;
+}
+
+// Forks the child that writes the snapshot and starts the thread that waits
+// for it
+internal_fn bool PlatformBeginSnapshotWrite(pthread_t *writer, char *filename,
+                                            Uint8 *memory,
+                                            Uint64 memory_size) {
+  snapshot_child_t *child =
+      (snapshot_child_t *)calloc(1, sizeof(snapshot_child_t));
+  if (child == NULL) {
+    return false;
+  }
+  child->start_ns = SDL_GetTicksNS();
+
+  // Truncating the last snapshot can take milliseconds, the child does it
+  int file_descriptor = open(filename, O_WRONLY | O_CREAT,
+                             S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  int result_pipe[2];
+  if (file_descriptor == -1 || pipe(result_pipe) == -1) {
+    if (file_descriptor != -1) {
+      close(file_descriptor);
+    }
+    free(child);
+    return false;
+  }
+
+  child->pid = fork();
+  if (child->pid == 0) {
+    // Gives the cores to the game first, the compressing threads inherit
+    // the priority
+    setpriority(PRIO_PROCESS, 0, 10);
+    close(result_pipe[0]);
+    snapshot_result_t result =
+        PlatformWriteSnapshot(file_descriptor, memory, memory_size);
+    write(result_pipe[1], &result, sizeof(result));
+    _exit(result.written ? 0 : 1);
+  }
+
+  close(file_descriptor);
+  close(result_pipe[1]);
+  child->result_pipe = result_pipe[0];
+  if (child->pid == -1) {
+    close(child->result_pipe);
+    free(child);
+    return false;
+  }
+
+  if (pthread_create(writer, NULL, PlatformSnapshotWriterThread, child) != 0) {
+    // Nothing else would reap it, so wait here and don't start recording
+    PlatformSnapshotWriterThread(child);
+    return false;
+  }
+  return true;
+}
+
+internal_fn bool PlatformRestoreSnapshot(char *filename, Uint8 *memory,
+                                         Uint64 memory_size) {
+  snapshot_job_t job = {};
+  job.memory = memory;
+  job.memory_size = memory_size;
+  job.file_descriptor = open(filename, O_RDONLY);
+  if (job.file_descriptor == -1) {
+    return false;
+  }
+
+  snapshot_header_t header = {};
+  if (!PlatformPReadAll(job.file_descriptor, (Uint8 *)&header, sizeof(header),
+                        0) ||
+      header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+      header.memory_size != memory_size ||
+      header.chunk_size != SNAPSHOT_CHUNK_SIZE) {
+    PlatformLog("%s is not a snapshot of this game memory", filename);
+    close(job.file_descriptor);
+    return false;
+  }
+
+  // The restore threads write wherever the index points, so a count that
+  // doesn't cover exactly this memory block would run past it
+  Uint32 expected_chunk_count =
+      (memory_size + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+  if (header.chunk_count != expected_chunk_count) {
+    PlatformLog("%s has %u chunks, expected %u", filename, header.chunk_count,
+                expected_chunk_count);
+    close(job.file_descriptor);
+    return false;
+  }
+
+  job.chunk_count = header.chunk_count;
+  job.index =
+      (snapshot_chunk_t *)malloc(job.chunk_count * sizeof(snapshot_chunk_t));
+  if (job.index == NULL ||
+      !PlatformPReadAll(job.file_descriptor, (Uint8 *)job.index,
+                        job.chunk_count * sizeof(snapshot_chunk_t),
+                        sizeof(header))) {
+    free(job.index);
+    close(job.file_descriptor);
+    return false;
+  }
+
+  PlatformRunSnapshotThreads(&job, PlatformSnapshotRestoreThread);
+
+  free(job.index);
+  close(job.file_descriptor);
+  return !job.failed;
+}
+
+// end Snapshots
+
 // Input recording and playback
 
+// Each recorded frame is the input and frame time that drove it followed by
+// the hash of the permanent storage after the update, when hashing was
+// enabled. Playback feeds the recorded delta_time back in, the live one would
+// make any time dependent update diverge.
+typedef struct recorded_input {
+  game_input_t input;
+  float delta_time;
+  Uint32 state_hash;
+  bool has_state_hash;
+} recorded_input_t;
+
 typedef struct platform_state {
 
   Uint64 game_memory_total_size;
@@ -165,30 +1645,55 @@ typedef struct platform_state {
   bool recording;
   bool playing;
 
+  // The snapshot of the last recording may still be being written
+  pthread_t snapshot_writer;
+  bool snapshot_writer_running;
+
+  int playback_frame_idx;
+  Uint32 playback_expected_hash;
+  bool playback_has_hash;
+  bool playback_diverged;
+
 } platform_state_t;
 
-const char *record_filename_format = "./tmp/playback_%d.dat";
+const char *snapshot_filename_format = "./tmp/playback_%d.dat";
+const char *record_filename_format = "./tmp/playback_%d.input";
+
+internal_fn void
+PlatformWaitForSnapshotWrite(platform_state_t *platform_state) {
+  if (platform_state->snapshot_writer_running) {
+    pthread_join(platform_state->snapshot_writer, NULL);
+    platform_state->snapshot_writer_running = false;
+  }
+}
 
 internal_fn void PlatformBeginRecordingInput(platform_state_t *platform_state,
                                              int recording_idx) {
-  if (platform_state->game_memory_total_size > 0xFFFFFFFF) {
-    SDL_Log("Attempted to read game memory that exceeds max 32bit int");
-    exit(1);
-  };
+  PlatformWaitForSnapshotWrite(platform_state);
+
   int namesize = 32;
   char name[namesize];
-  SDL_snprintf(name, namesize, record_filename_format, recording_idx);
+  SDL_snprintf(name, namesize, snapshot_filename_format, recording_idx);
   platform_state->input_recording_idx = recording_idx;
+
+  if (!PlatformBeginSnapshotWrite(&platform_state->snapshot_writer, name,
+                                  (Uint8 *)platform_state->game_memory_block,
+                                  platform_state->game_memory_total_size)) {
+    PlatformLog("Failed to record game memory block");
+    return;
+  }
+  platform_state->snapshot_writer_running = true;
+
+  SDL_snprintf(name, namesize, record_filename_format, recording_idx);
   platform_state->input_recording_file_descriptor =
-      open(name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+      open(name, O_WRONLY | O_CREAT | O_TRUNC,
+           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
-  if (write(platform_state->input_recording_file_descriptor,
-            platform_state->game_memory_block,
-            platform_state->game_memory_total_size)) {
-    SDL_Log("Recorded game memory block");
+  if (platform_state->input_recording_file_descriptor != -1) {
+    PlatformLog("Recorded game memory block");
     platform_state->recording = true;
   } else {
-    SDL_Log("Failed to record game memory block");
+    PlatformLog("Failed to open %s", name);
   }
 }
 internal_fn void PlatformEndRecordingInput(platform_state_t *platform_state) {
@@ -198,23 +1703,28 @@ internal_fn void PlatformEndRecordingInput(platform_state_t *platform_state) {
 
 internal_fn void PlatformBeginPlaybackInput(platform_state_t *platform_state,
                                             int playback_idx) {
-  if (platform_state->game_memory_total_size > 0xFFFFFFFF) {
-    SDL_Log("Attempted to write game memory that exceeds max 32bit int");
-    exit(1);
-  };
+  // Only stalls if playback starts before the recording's snapshot is done
+  PlatformWaitForSnapshotWrite(platform_state);
+
   int namesize = 32;
   char name[namesize];
-  SDL_snprintf(name, namesize, record_filename_format, playback_idx);
+  SDL_snprintf(name, namesize, snapshot_filename_format, playback_idx);
 
   platform_state->input_playback_idx = playback_idx;
+  if (!PlatformRestoreSnapshot(name, (Uint8 *)platform_state->game_memory_block,
+                               platform_state->game_memory_total_size)) {
+    PlatformLog("Failed to recover game memory block");
+    return;
+  }
+
+  SDL_snprintf(name, namesize, record_filename_format, playback_idx);
   platform_state->input_playback_file_descriptor = open(name, O_RDONLY);
-  if (read(platform_state->input_playback_file_descriptor,
-           platform_state->game_memory_block,
-           platform_state->game_memory_total_size)) {
-    SDL_Log("Recovered game memory block");
+  if (platform_state->input_playback_file_descriptor != -1) {
+    PlatformLog("Recovered game memory block");
     platform_state->playing = true;
+    platform_state->playback_frame_idx = 0;
   } else {
-    SDL_Log("Failed to recover game memory block");
+    PlatformLog("Failed to open %s", name);
   }
 }
 internal_fn void PlatformEndPlaybackInput(platform_state_t *platform_state) {
@@ -223,38 +1733,203 @@ internal_fn void PlatformEndPlaybackInput(platform_state_t *platform_state) {
 }
 
 internal_fn void PlatformRecordInput(platform_state_t *platform_state,
-                                     game_input_t *input) {
-
-  if (write(platform_state->input_recording_file_descriptor, input,
-            sizeof(*input))) {
+                                     game_input_t *input, float delta_time,
+                                     bool has_state_hash, Uint32 state_hash) {
+  recorded_input_t record = {};
+  record.input = *input;
+  record.delta_time = delta_time;
+  record.state_hash = state_hash;
+  record.has_state_hash = has_state_hash;
+
+  if (write(platform_state->input_recording_file_descriptor, &record,
+            sizeof(record))) {
     // SDL_Log("Recorded an input");
   } else {
-    SDL_Log("Failed to record an input");
+    PlatformLog("Failed to record an input");
+  }
+}
+
+internal_fn bool PlatformReadRecordedInput(platform_state_t *platform_state,
+                                           game_input_t *input,
+                                           float *delta_time) {
+  recorded_input_t record = {};
+  if (read(platform_state->input_playback_file_descriptor, &record,
+           sizeof(record)) != sizeof(record)) {
+    return false;
   }
+  *input = record.input;
+  *delta_time = record.delta_time;
+  platform_state->playback_expected_hash = record.state_hash;
+  platform_state->playback_has_hash = record.has_state_hash;
+  return true;
 }
 
 internal_fn void PlatformPlaybackInput(platform_state_t *platform_state,
-                                       game_input_t *input) {
-  if (read(platform_state->input_recording_file_descriptor, input,
-           sizeof(*input))) {
+                                       game_input_t *input,
+                                       float *delta_time) {
+  if (PlatformReadRecordedInput(platform_state, input, delta_time)) {
     // SDL_Log("Played back an input");
   } else {
-    SDL_Log("Looping playback");
+    PlatformLog("Looping playback");
     int playing_idx = platform_state->input_playback_idx;
     PlatformEndPlaybackInput(platform_state);
 
+#if IN_DEVELOPMENT
+    PlatformCapturePlaybackLooped(&frame_capture, playing_idx);
+#endif
     PlatformBeginPlaybackInput(platform_state, playing_idx);
-    read(platform_state->input_recording_file_descriptor, input,
-         sizeof(*input));
+    PlatformReadRecordedInput(platform_state, input, delta_time);
+  }
+}
+
+// Called after the update of a replayed frame, only reports the first
+// divergence of each loop so a broken replay doesn't flood the log
+internal_fn void PlatformCheckPlaybackHash(platform_state_t *platform_state,
+                                           bool has_state_hash,
+                                           Uint32 state_hash) {
+  int frame_idx = platform_state->playback_frame_idx++;
+  if (frame_idx == 0) {
+    platform_state->playback_diverged = false;
+  }
+  if (!has_state_hash || !platform_state->playback_has_hash ||
+      platform_state->playback_diverged) {
+    return;
+  }
+  if (state_hash != platform_state->playback_expected_hash) {
+    platform_state->playback_diverged = true;
+    PlatformLog("Playback diverged at frame %d: expected %08x, got %08x",
+                frame_idx, platform_state->playback_expected_hash, state_hash);
   }
 }
 
 // end Input recording and playback
 
+// Memory telemetry
+
+// We reserve far more than the game touches, so about once a second the
+// residency of both regions is sampled with mincore along with the process
+// RSS and fault counters, and logged with the game's permanent storage
+// high-water mark. Once the game sets transient_storage_used the transient
+// pages past it are released with MADV_DONTNEED first, a playback restore
+// faults in the whole block and this hands it back.
+
+const Uint64 memory_stats_sample_interval = 1000;
+const int memory_stats_log_interval = 10;
+
+global_variable Uint64 memory_stats_page_size;
+global_variable Uint8 *memory_stats_residency;
+global_variable Uint64 memory_stats_next_sample_tick;
+global_variable int memory_stats_sample_count;
+
+internal_fn void PlatformInitMemoryStats(game_memory_t *memory) {
+  memory_stats_page_size = sysconf(_SC_PAGESIZE);
+  Uint64 largest_region =
+      SDL_max(memory->permanent_storage_size, memory->transient_storage_size);
+  memory_stats_residency = (Uint8 *)malloc(
+      (largest_region + memory_stats_page_size - 1) / memory_stats_page_size);
+  if (memory_stats_residency == NULL) {
+    PlatformLog("Unable to allocate residency vector, memory stats disabled");
+  }
+}
+
+internal_fn Uint64 PlatformCountResidentBytes(void *base, Uint64 size) {
+  if (size == 0 || mincore(base, size, memory_stats_residency) != 0) {
+    return 0;
+  }
+  Uint64 page_count =
+      (size + memory_stats_page_size - 1) / memory_stats_page_size;
+  Uint64 resident_pages = 0;
+  for (Uint64 page_i = 0; page_i < page_count; page_i++) {
+    resident_pages += memory_stats_residency[page_i] & 1;
+  }
+  return resident_pages * memory_stats_page_size;
+}
+
+internal_fn void PlatformReleaseIdleTransient(game_memory_t *memory) {
+  if (memory->transient_storage_used == GAME_STORAGE_USED_UNKNOWN) {
+    return;
+  }
+  Uint64 used = SDL_min(memory->transient_storage_used,
+                        memory->transient_storage_size);
+  // Round up, the page holding the end of the used range stays
+  used = (used + memory_stats_page_size - 1) & ~(memory_stats_page_size - 1);
+  if (used >= memory->transient_storage_size) {
+    return;
+  }
+
+  Uint8 *idle_start = (Uint8 *)memory->transient_storage + used;
+  Uint64 idle_size = memory->transient_storage_size - used;
+  Uint64 idle_resident = PlatformCountResidentBytes(idle_start, idle_size);
+  if (idle_resident > 0 && madvise(idle_start, idle_size, MADV_DONTNEED) == 0) {
+    memory->stats.transient_released_bytes += idle_resident;
+  }
+}
+
+internal_fn void PlatformUpdateMemoryStats(game_memory_t *memory,
+                                           Uint64 current_tick) {
+  if (memory_stats_residency == NULL ||
+      current_tick < memory_stats_next_sample_tick) {
+    return;
+  }
+  memory_stats_next_sample_tick = current_tick + memory_stats_sample_interval;
+
+  PlatformReleaseIdleTransient(memory);
+
+  game_memory_stats_t *stats = &memory->stats;
+  stats->permanent_resident_bytes = PlatformCountResidentBytes(
+      memory->permanent_storage, memory->permanent_storage_size);
+  stats->transient_resident_bytes = PlatformCountResidentBytes(
+      memory->transient_storage, memory->transient_storage_size);
+  stats->permanent_resident_peak_bytes = SDL_max(
+      stats->permanent_resident_peak_bytes, stats->permanent_resident_bytes);
+  stats->transient_resident_peak_bytes = SDL_max(
+      stats->transient_resident_peak_bytes, stats->transient_resident_bytes);
+
+  // statm reports the current RSS in pages, getrusage only has the peak
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    Uint64 total_pages = 0;
+    Uint64 resident_pages = 0;
+    if (fscanf(statm, "%lu %lu", &total_pages, &resident_pages) == 2) {
+      stats->process_resident_bytes = resident_pages * memory_stats_page_size;
+    }
+    fclose(statm);
+  }
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats->process_resident_peak_bytes = Kilobytes(usage.ru_maxrss);
+    stats->minor_page_faults = usage.ru_minflt;
+    stats->major_page_faults = usage.ru_majflt;
+  }
+
+  if (memory_stats_sample_count++ % memory_stats_log_interval == 0) {
+    PlatformLog("Memory: permanent %luK (peak %luK, used %luK), transient "
+                "%luK (peak %luK, released %luK), rss %luK (peak %luK), "
+                "faults %lu minor %lu major",
+                stats->permanent_resident_bytes / 1024,
+                stats->permanent_resident_peak_bytes / 1024,
+                memory->permanent_storage_used / 1024,
+                stats->transient_resident_bytes / 1024,
+                stats->transient_resident_peak_bytes / 1024,
+                stats->transient_released_bytes / 1024,
+                stats->process_resident_bytes / 1024,
+                stats->process_resident_peak_bytes / 1024,
+                stats->minor_page_faults, stats->major_page_faults);
+  }
+}
+
+// end Memory telemetry
+
+// Work queue
+
+#include "linux_work_queue.cpp"
+
+// end Work queue
+
 // Should eliminate some or all of these globals
 
 global_variable int target_fps;
-global_variable Uint64 target_frame_time;
 global_variable int target_physics_updates_ps;
 global_variable Uint64 target_physics_time;
 
@@ -262,13 +1937,6 @@ global_variable bool quit = false;
 
 const int scale = 1;
 
-offscreen_buffer pixel_buffer =
-    (offscreen_buffer){.width = WIDTH,
-                       .height = HEIGHT,
-                       .length = WIDTH * HEIGHT * BYTES_PER_PX,
-                       .bytes_per_px = BYTES_PER_PX,
-                       .buffer = {}};
-
 global_variable int nGamepads;
 global_variable SDL_JoystickID *joystickId;
 global_variable SDL_Gamepad *gamepad;
@@ -277,288 +1945,708 @@ global_variable int left_stick_deadzone = 9000;
 
 // end globals
 
-internal_fn void PlatformHandleInputButton(game_button_state_t *new_state,
-                                           bool value) {
-  new_state->ended_down = value;
-  new_state->half_transition_count++;
-}
-
-internal_fn void PlatformHandleGamepadButton(game_button_state_t *old_state,
-                                             game_button_state_t *new_state,
-                                             bool value) {
-  new_state->ended_down = value;
-  new_state->half_transition_count +=
-      ((new_state->ended_down == old_state->ended_down) ? 0 : 1);
-}
-
-internal_fn float PlatformGetGamepadAxisValue(int16_t value, int16_t deadzone) {
-  float result = 0;
-  if (value < -deadzone) {
-    result = (float)((value + deadzone) / (32768.0f - deadzone));
-  } else if (value > deadzone) {
-    result = (float)((value - deadzone) / (32767.0f - deadzone));
-  }
-  return result;
-}
+// Input bindings
 
-internal_fn void PlatformHandleInputEvent(SDL_Event *event,
-                                          game_input_t *new_input,
-                                          game_input_t *old_input,
-                                          platform_state_t *platform_state) {
-  // Mouse for debug purposes
-  // Generates multiple events per frame which is not desireable
-  // uint leftclick = (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON_LMASK);
-  // can be used to detect a mouse click
+#include "linux_input.cpp"
 
-  float mouseX_f;
-  float mouseY_f;
-  SDL_GetMouseState(&mouseX_f, &mouseY_f);
-  new_input->mouseX = (Uint32)mouseX_f;
-  new_input->mouseY = (Uint32)mouseY_f;
-  // new_input->mouseY = 0; // Support mouse wheel scroll?
+const char *input_bindings_name = "./bindings.txt";
+global_variable time_t input_bindings_st_mtime;
 
-  if (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN ||
-      event->type == SDL_EVENT_MOUSE_BUTTON_UP) {
-    if (event->button.button == SDL_BUTTON_LEFT) {
-      PlatformHandleInputButton(&new_input->left_click, event->button.down);
-    }
-    if (event->button.button == SDL_BUTTON_RIGHT) {
-      PlatformHandleInputButton(&new_input->right_click, event->button.down);
-    }
+internal_fn void PlatformLoadInputBindings() {
+  input_bindings_t bindings;
+  debug_read_file_result_t file =
+      DEBUGPlatformReadEntireFile((char *)input_bindings_name);
+  if (file.contents) {
+    PlatformParseInputBindings((char *)file.contents, file.contents_size,
+                               input_bindings_name, &bindings);
+    DEBUGPlatformFreeFileMemory(file.contents);
+    PlatformLog("Loaded input bindings from %s", input_bindings_name);
+  } else {
+    PlatformParseInputBindings(default_input_bindings,
+                               sizeof(default_input_bindings) - 1, "defaults",
+                               &bindings);
+    PlatformLog("No %s, using the default input bindings",
+                input_bindings_name);
   }
+  input_bindings = bindings;
 
-  // Keyboard inputs
-  if (event->type == SDL_EVENT_KEY_DOWN || event->type == SDL_EVENT_KEY_UP) {
-
-    if (event->key.key == SDLK_ESCAPE) {
-      SDL_Log("Keyboard: Esc");
-      quit = true;
-    }
+  struct stat attr;
+  if (stat(input_bindings_name, &attr) == 0) {
+    input_bindings_st_mtime = attr.st_mtime;
+  }
+}
 
-    if (event->key.repeat == 0) {
+// Called between frames, the new table is swapped in whole
+internal_fn void PlatformReloadInputBindings() {
+  struct stat attr;
+  if (stat(input_bindings_name, &attr) == 0 &&
+      attr.st_mtime > input_bindings_st_mtime) {
+    PlatformLoadInputBindings();
+  }
+}
 
+// The hotkeys PlatformHandleInputEvent hands back, dev builds only
+internal_fn void PlatformHandleHotkeys(Uint32 hotkeys, game_input_t *new_input,
+                                       platform_state_t *platform_state) {
 #if IN_DEVELOPMENT
 
-      if ((!platform_state->recording) && (!platform_state->playing)) {
-        if (event->key.mod & SDL_KMOD_ALT && event->key.key == SDLK_7 &&
-            event->key.down) {
-          platform_state->input_recording_idx = 0;
-          platform_state->input_playback_idx = 0;
-          SDL_Log("Save state slot 0");
-        }
-        if (event->key.mod & SDL_KMOD_ALT && event->key.key == SDLK_8 &&
-            event->key.down) {
-          platform_state->input_recording_idx = 1;
-          platform_state->input_playback_idx = 1;
-          SDL_Log("Save state slot 1");
-        }
-        if (event->key.mod & SDL_KMOD_ALT && event->key.key == SDLK_9 &&
-            event->key.down) {
-          platform_state->input_recording_idx = 2;
-          platform_state->input_playback_idx = 2;
-          SDL_Log("Save state slot 2");
-        }
-        if (event->key.mod & SDL_KMOD_ALT && event->key.key == SDLK_0 &&
-            event->key.down) {
-          platform_state->input_recording_idx = 3;
-          platform_state->input_playback_idx = 3;
-          SDL_Log("Save state slot 3");
-        }
+  if (!platform_state->recording && !platform_state->playing) {
+    for (int slot_i = 0; slot_i < 4; slot_i++) {
+      if (hotkeys & (1u << (INPUT_ACTION_SAVE_SLOT_0 + slot_i))) {
+        platform_state->input_recording_idx = slot_i;
+        platform_state->input_playback_idx = slot_i;
+        PlatformLog("Save state slot %d", slot_i);
       }
+    }
+  }
 
-      if (event->key.key == SDLK_L && event->key.down) {
-        if (!platform_state->playing) {
-          if (!platform_state->recording) {
-            PlatformBeginRecordingInput(platform_state,
-                                        platform_state->input_recording_idx);
-          } else {
-            PlatformEndRecordingInput(platform_state);
-            PlatformBeginPlaybackInput(platform_state,
-                                       platform_state->input_playback_idx);
-          }
-        } else {
-          PlatformEndPlaybackInput(platform_state);
-          new_input->controller = {};
-        }
+  if (hotkeys & (1u << INPUT_ACTION_TOGGLE_RECORDING)) {
+    if (!platform_state->playing) {
+      if (!platform_state->recording) {
+        PlatformBeginRecordingInput(platform_state,
+                                    platform_state->input_recording_idx);
+      } else {
+        PlatformEndRecordingInput(platform_state);
+        PlatformBeginPlaybackInput(platform_state,
+                                   platform_state->input_playback_idx);
+      }
+    } else {
+      PlatformEndPlaybackInput(platform_state);
+      new_input->controller = {};
+      if (frame_capture.mode == CAPTURE_ARMED_FOR_PLAYBACK ||
+          frame_capture.mode == CAPTURE_PLAYBACK) {
+        PlatformStopCapture(&frame_capture);
       }
+    }
+  }
+
+  if (hotkeys & (1u << INPUT_ACTION_TOGGLE_CAPTURE)) {
+    PlatformToggleCapture(&frame_capture, platform_state->playing,
+                          platform_state->playing
+                              ? platform_state->input_playback_idx
+                              : platform_state->input_recording_idx);
+  }
 
 #else
 // Disable input recording and playback for non-DEV builds
 #endif
+}
 
-      if (event->key.key == SDLK_W) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_north,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_A) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_west,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_S) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_south,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_D) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_east,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_UP) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_north,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_LEFT) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_west,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_DOWN) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_south,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_RIGHT) {
-        new_input->controller.is_analog = false;
-        PlatformHandleInputButton(&new_input->controller.move_east,
-                                  event->key.down);
-      }
+// end Input bindings
+
+
+// Performance counters
+
+// Each measured thread opens its own perf_event_open group and a stretch of
+// the frame is measured by reading the whole group before and after it, one
+// read() each. Counts follow the opening thread only, so work the game hands
+// to the work queue isn't in the update figures, run with WORKER_THREADS=0 to
+// count a whole update. Counters the CPU or VM doesn't have, or that
+// perf_event_paranoid forbids, are left out of the group and read as zero.
+// With nothing open the reads are skipped. When the PMU is shared the group
+// is scaled by the time it actually ran, and a stretch where it never got
+// scheduled reports no counters.
+
+const Uint64 perf_log_interval = 10000;
+
+typedef struct perf_counter_event {
+  Uint32 type;
+  Uint64 config;
+  const char *name;
+} perf_counter_event_t;
+
+const perf_counter_event_t perf_counter_events[GAME_PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+     "L1D misses"},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+     "LLC misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page faults"},
+};
 
-      if (event->key.key == SDLK_E) {
-        PlatformHandleInputButton(&new_input->controller.action_south,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_F) {
-        PlatformHandleInputButton(&new_input->controller.action_east,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_Q) {
-        PlatformHandleInputButton(&new_input->controller.action_west,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_R) {
-        PlatformHandleInputButton(&new_input->controller.action_north,
-                                  event->key.down);
+// Layout of a PERF_FORMAT_GROUP read with both times
+typedef struct perf_group_read {
+  Uint64 member_count;
+  Uint64 time_enabled;
+  Uint64 time_running;
+  Uint64 values[GAME_PERF_COUNTER_COUNT];
+} perf_group_read_t;
+
+typedef struct perf_counter_group {
+  int leader_fd;
+  int fds[GAME_PERF_COUNTER_COUNT];
+  // Position of each counter in the group read, -1 when it isn't open
+  int value_idx[GAME_PERF_COUNTER_COUNT];
+  int member_count;
+  Uint32 counters;
+
+  bool started;
+  perf_group_read_t start;
+} perf_counter_group_t;
+
+// Counts the main thread's present
+global_variable perf_counter_group_t draw_counters;
+global_variable Uint64 perf_next_log_tick;
+
+// Opens the group on the calling thread, which is the one it counts
+internal_fn void PlatformOpenPerfCounters(perf_counter_group_t *group,
+                                          const char *thread_name) {
+  *group = {};
+  group->leader_fd = -1;
+  int first_errno = 0;
+
+  for (int counter_i = 0; counter_i < GAME_PERF_COUNTER_COUNT; counter_i++) {
+    group->fds[counter_i] = -1;
+    group->value_idx[counter_i] = -1;
+
+    struct perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = perf_counter_events[counter_i].type;
+    attr.config = perf_counter_events[counter_i].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // User space only, which is all perf_event_paranoid 2 allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // The first counter that opens leads the group, so a VM without a PMU
+    // still gets the software page fault counter
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group->leader_fd,
+                          PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1) {
+      if (first_errno == 0) {
+        first_errno = errno;
       }
+      continue;
+    }
+    if (group->leader_fd == -1) {
+      group->leader_fd = fd;
+    }
+    group->fds[counter_i] = fd;
+    group->value_idx[counter_i] = group->member_count++;
+    group->counters |= 1u << counter_i;
+  }
 
-      if (event->key.key == SDLK_LSHIFT) {
-        PlatformHandleInputButton(&new_input->controller.left_shoulder,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_LCTRL) {
-        PlatformHandleInputButton(&new_input->controller.right_shoulder,
-                                  event->key.down);
-      }
+  if (group->counters == 0) {
+    PlatformLog("Performance counters unavailable on the %s thread: %s%s",
+                thread_name, strerror(first_errno),
+                (first_errno == EACCES || first_errno == EPERM)
+                    ? ", see /proc/sys/kernel/perf_event_paranoid"
+                    : "");
+    return;
+  }
 
-      if (event->key.key == SDLK_P) {
-        PlatformHandleInputButton(&new_input->controller.start,
-                                  event->key.down);
-      }
-      if (event->key.key == SDLK_I) {
-        PlatformHandleInputButton(&new_input->controller.select,
-                                  event->key.down);
-      }
+  char missing[128] = "";
+  for (int counter_i = 0; counter_i < GAME_PERF_COUNTER_COUNT; counter_i++) {
+    if (!(group->counters & (1u << counter_i))) {
+      SDL_snprintf(missing + strlen(missing), sizeof(missing) - strlen(missing),
+                   ", no %s", perf_counter_events[counter_i].name);
     }
   }
+  if (first_errno) {
+    SDL_snprintf(missing + strlen(missing), sizeof(missing) - strlen(missing),
+                 " (%s)", strerror(first_errno));
+  }
+  PlatformLog("Performance counters open on the %s thread%s", thread_name,
+              missing);
+}
 
-  // Gamepad inputs
-  if (event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
-    if (event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTX ||
-        event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFTY) {
+internal_fn void PlatformClosePerfCounters(perf_counter_group_t *group) {
+  for (int counter_i = 0; counter_i < GAME_PERF_COUNTER_COUNT; counter_i++) {
+    if (group->fds[counter_i] != -1) {
+      close(group->fds[counter_i]);
+      group->fds[counter_i] = -1;
+    }
+  }
+  group->leader_fd = -1;
+  group->counters = 0;
+}
 
-      new_input->controller.is_analog = true;
+internal_fn bool PlatformReadPerfGroup(perf_counter_group_t *group,
+                                       perf_group_read_t *result) {
+  if (group->leader_fd == -1) {
+    return false;
+  }
+  ssize_t expected = (3 + group->member_count) * sizeof(Uint64);
+  return read(group->leader_fd, result, sizeof(*result)) >= expected;
+}
 
-      new_input->controller.left_stick_average_x =
-          PlatformGetGamepadAxisValue(event->gaxis.value, left_stick_deadzone);
-      new_input->controller.left_stick_average_y =
-          PlatformGetGamepadAxisValue(event->gaxis.value, left_stick_deadzone);
+internal_fn void PlatformBeginPerfCounters(perf_counter_group_t *group) {
+  group->started = PlatformReadPerfGroup(group, &group->start);
+}
 
-      float threshold = 0.5f;
-      PlatformHandleGamepadButton(
-          &old_input->controller.move_west, &new_input->controller.move_west,
-          new_input->controller.left_stick_average_x < -threshold);
-      PlatformHandleGamepadButton(
-          &old_input->controller.move_east, &new_input->controller.move_east,
-          new_input->controller.left_stick_average_x > threshold);
-      PlatformHandleGamepadButton(
-          &old_input->controller.move_north, &new_input->controller.move_north,
-          new_input->controller.left_stick_average_y < -threshold);
-      PlatformHandleGamepadButton(
-          &old_input->controller.move_south, &new_input->controller.move_south,
-          new_input->controller.left_stick_average_y > threshold);
-    }
+internal_fn void PlatformEndPerfCounters(perf_counter_group_t *group,
+                                         game_perf_sample_t *sample) {
+  *sample = {};
+  perf_group_read_t end;
+  if (!group->started || !PlatformReadPerfGroup(group, &end)) {
+    return;
   }
+  group->started = false;
 
-  if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN ||
-      event->type == SDL_EVENT_GAMEPAD_BUTTON_UP) {
+  Uint64 enabled_ns = end.time_enabled - group->start.time_enabled;
+  Uint64 running_ns = end.time_running - group->start.time_running;
+  if (running_ns == 0) {
+    return;
+  }
 
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_START) {
-      PlatformHandleInputButton(&new_input->controller.start,
-                                event->gbutton.down);
-      quit = true;
+  for (int counter_i = 0; counter_i < GAME_PERF_COUNTER_COUNT; counter_i++) {
+    int value_i = group->value_idx[counter_i];
+    if (value_i == -1) {
+      continue;
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_BACK) {
-      PlatformHandleInputButton(&new_input->controller.select,
-                                event->gbutton.down);
+    Uint64 value = end.values[value_i] - group->start.values[value_i];
+    if (running_ns < enabled_ns) {
+      value = (Uint64)((double)value * enabled_ns / running_ns);
     }
+    sample->values[counter_i] = value;
+  }
+  sample->counters = group->counters;
 
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_LEFT_SHOULDER) {
-      PlatformHandleInputButton(&new_input->controller.left_shoulder,
-                                event->gbutton.down);
-    }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER) {
-      PlatformHandleInputButton(&new_input->controller.right_shoulder,
-                                event->gbutton.down);
-    }
+  Uint64 cycles = sample->values[GAME_PERF_CYCLES];
+  Uint64 instructions = sample->values[GAME_PERF_INSTRUCTIONS];
+  if (cycles) {
+    sample->instructions_per_cycle = (float)instructions / cycles;
+  }
+  if (instructions) {
+    float per_kilo_instruction = 1000.0f / instructions;
+    sample->l1d_misses_per_kilo_instruction =
+        sample->values[GAME_PERF_L1D_MISSES] * per_kilo_instruction;
+    sample->llc_misses_per_kilo_instruction =
+        sample->values[GAME_PERF_LLC_MISSES] * per_kilo_instruction;
+    sample->branch_misses_per_kilo_instruction =
+        sample->values[GAME_PERF_BRANCH_MISSES] * per_kilo_instruction;
+  }
+}
 
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_WEST) {
-      PlatformHandleInputButton(&new_input->controller.action_west,
-                                event->gbutton.down);
-    }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_NORTH) {
-      PlatformHandleInputButton(&new_input->controller.action_north,
-                                event->gbutton.down);
+// Called between frames while the simulation thread is idle, so the game
+// never sees a half written entry
+internal_fn void PlatformRecordPerfFrame(game_perf_history_t *history,
+                                         game_perf_sample_t *update,
+                                         game_perf_sample_t *draw) {
+  game_perf_frame_t *frame =
+      &history->frames[history->frame_count % GAME_PERF_HISTORY];
+  frame->update = *update;
+  frame->draw = *draw;
+  history->frame_count++;
+}
+
+// Averages the update or draw samples into line, false if none were counted
+internal_fn bool PlatformFormatPerfSamples(char *line, size_t line_size,
+                                           game_perf_history_t *history,
+                                           bool draw) {
+  Uint64 frame_count = SDL_min(history->frame_count, GAME_PERF_HISTORY);
+  Uint64 totals[GAME_PERF_COUNTER_COUNT] = {};
+  Uint32 counters = 0;
+  Uint64 counted_frames = 0;
+  for (Uint64 frame_i = 0; frame_i < frame_count; frame_i++) {
+    game_perf_frame_t *frame = &history->frames[frame_i];
+    game_perf_sample_t *sample = draw ? &frame->draw : &frame->update;
+    if (!sample->counters) {
+      continue;
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_SOUTH) {
-      PlatformHandleInputButton(&new_input->controller.action_south,
-                                event->gbutton.down);
+    counters |= sample->counters;
+    counted_frames++;
+    for (int counter_i = 0; counter_i < GAME_PERF_COUNTER_COUNT; counter_i++) {
+      totals[counter_i] += sample->values[counter_i];
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_EAST) {
-      PlatformHandleInputButton(&new_input->controller.action_east,
-                                event->gbutton.down);
+  }
+  if (counted_frames == 0) {
+    return false;
+  }
+
+  // Only what was counted goes in the line
+  line[0] = '\0';
+  int length = 0;
+  Uint64 instructions = totals[GAME_PERF_INSTRUCTIONS];
+  if (counters & (1u << GAME_PERF_INSTRUCTIONS)) {
+    length += SDL_snprintf(line + length, line_size - length,
+                           " %.2fM instructions/frame",
+                           instructions / 1000000.0 / counted_frames);
+  }
+  if ((counters & (1u << GAME_PERF_CYCLES)) && totals[GAME_PERF_CYCLES]) {
+    length += SDL_snprintf(line + length, line_size - length, " IPC %.2f",
+                           (double)instructions / totals[GAME_PERF_CYCLES]);
+  }
+  const char *miss_names[] = {"L1D", "LLC", "branch"};
+  game_perf_counter_t miss_counters[] = {
+      GAME_PERF_L1D_MISSES, GAME_PERF_LLC_MISSES, GAME_PERF_BRANCH_MISSES};
+  for (int miss_i = 0; miss_i < 3; miss_i++) {
+    if ((counters & (1u << miss_counters[miss_i])) && instructions) {
+      length += SDL_snprintf(line + length, line_size - length,
+                             " %s %.2f/1k", miss_names[miss_i],
+                             totals[miss_counters[miss_i]] * 1000.0 /
+                                 instructions);
     }
+  }
+  if (counters & (1u << GAME_PERF_PAGE_FAULTS)) {
+    SDL_snprintf(line + length, line_size - length, " %.1f faults/frame",
+                 (double)totals[GAME_PERF_PAGE_FAULTS] / counted_frames);
+  }
+  return true;
+}
 
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_DPAD_UP) {
-      new_input->controller.is_analog = false;
-      PlatformHandleInputButton(&new_input->controller.move_north,
-                                event->gbutton.down);
+// Averages over the history every perf_log_interval
+internal_fn void PlatformLogPerfCounters(game_perf_history_t *history,
+                                         Uint64 current_tick) {
+  if (current_tick < perf_next_log_tick) {
+    return;
+  }
+  if (perf_next_log_tick != 0) {
+    // Separate formats and lines, each side fills most of a log record
+    char line[160];
+    if (PlatformFormatPerfSamples(line, sizeof(line), history, false)) {
+      PlatformLog("Update perf:%s", line);
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_DPAD_DOWN) {
-      new_input->controller.is_analog = false;
-      PlatformHandleInputButton(&new_input->controller.move_south,
-                                event->gbutton.down);
+    if (PlatformFormatPerfSamples(line, sizeof(line), history, true)) {
+      PlatformLog("Draw perf:%s", line);
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_DPAD_LEFT) {
-      new_input->controller.is_analog = false;
-      PlatformHandleInputButton(&new_input->controller.move_west,
-                                event->gbutton.down);
+  }
+  perf_next_log_tick = current_tick + perf_log_interval;
+}
+
+// end Performance counters
+
+// Frame pipeline
+
+// game_update_and_render runs on a simulation thread so frame N+1 is simulated
+// while the main thread uploads and presents frame N. SDL wants rendering and
+// events on the main thread, so it's the simulation that moves rather than
+// the present. Frames are handed over through three offscreen_buffers, the
+// simulation owns the back buffer, the main thread owns the front buffer and
+// the third is traded between them with a single atomic exchange.
+
+#define FRAME_READY_IDX_MASK 0x3
+#define FRAME_READY_NEW 0x4
+
+const Uint64 frame_pipeline_log_interval = 10000;
+
+typedef struct frame_pipeline {
+  offscreen_buffer buffers[3];
+
+  // Index of the last finished frame, FRAME_READY_NEW is set until the main
+  // thread picks it up
+  Uint32 ready;
+  int back_idx;
+  int front_idx;
+
+  pthread_t sim_thread;
+  sem_t sim_start;
+  sem_t sim_done;
+  bool sim_in_flight;
+  bool sim_quit;
+
+  // Set by the main thread before it posts sim_start
+  thread_context_t *thread_context;
+  game_memory_t *memory;
+  game_input_t *input;
+  float delta_time;
+
+  // Opened by the simulation thread, the sample covers the last update and
+  // is only read after sim_done
+  perf_counter_group_t sim_counters;
+  game_perf_sample_t update_sample;
+
+  // Accumulated until the next log line, the simulation thread's counters
+  // are only read after sim_done
+  Uint64 sim_ns;
+  Uint64 wait_ns;
+  Uint32 frames_simulated;
+  Uint32 frames_presented;
+  Uint32 frames_dropped;
+  Uint32 frames_duplicated;
+  Uint64 next_log_tick;
+} frame_pipeline_t;
+
+global_variable frame_pipeline_t frame_pipeline;
+
+// Simulation thread side
+internal_fn void PlatformPublishFrame(frame_pipeline_t *pipeline) {
+  int published_idx = pipeline->back_idx;
+  Uint32 previous =
+      __atomic_exchange_n(&pipeline->ready, published_idx | FRAME_READY_NEW,
+                          __ATOMIC_ACQ_REL);
+  if (previous & FRAME_READY_NEW) {
+    pipeline->frames_dropped++;
+  }
+  pipeline->back_idx = previous & FRAME_READY_IDX_MASK;
+
+  // The game draws on top of its last frame, so carry it over. The main
+  // thread may be reading the published buffer too, but neither side writes
+  offscreen_buffer *published = &pipeline->buffers[published_idx];
+  memcpy(pipeline->buffers[pipeline->back_idx].buffer, published->buffer,
+         published->length);
+}
+
+// Main thread side, falls back to the current front buffer when the
+// simulation hasn't finished anything new
+internal_fn offscreen_buffer *PlatformAcquireFrame(frame_pipeline_t *pipeline) {
+  if (__atomic_load_n(&pipeline->ready, __ATOMIC_ACQUIRE) & FRAME_READY_NEW) {
+    Uint32 previous = __atomic_exchange_n(&pipeline->ready, pipeline->front_idx,
+                                          __ATOMIC_ACQ_REL);
+    pipeline->front_idx = previous & FRAME_READY_IDX_MASK;
+  } else {
+    pipeline->frames_duplicated++;
+  }
+  pipeline->frames_presented++;
+  return &pipeline->buffers[pipeline->front_idx];
+}
+
+internal_fn void *PlatformSimulationThread(void *arg) {
+  frame_pipeline_t *pipeline = (frame_pipeline_t *)arg;
+
+  PlatformOpenPerfCounters(&pipeline->sim_counters, "simulation");
+
+  for (;;) {
+    while (sem_wait(&pipeline->sim_start) == -1) {
+      // Interrupted by a signal
     }
-    if (event->gbutton.button == SDL_GAMEPAD_BUTTON_DPAD_RIGHT) {
-      new_input->controller.is_analog = false;
-      PlatformHandleInputButton(&new_input->controller.move_east,
-                                event->gbutton.down);
+    if (pipeline->sim_quit) {
+      break;
     }
+
+    Uint64 start_ns = SDL_GetTicksNS();
+    offscreen_buffer *back = &pipeline->buffers[pipeline->back_idx];
+    PlatformBeginPerfCounters(&pipeline->sim_counters);
+
+#if STATIC_WHOLE_COMPILE
+
+    game_update_and_render(pipeline->thread_context, pipeline->memory, back,
+                           pipeline->input, pipeline->delta_time);
+
+#else
+
+    (*game_update_and_render_ptr)(pipeline->thread_context, pipeline->memory,
+                                  back, pipeline->input, pipeline->delta_time);
+
+#endif
+
+    PlatformEndPerfCounters(&pipeline->sim_counters, &pipeline->update_sample);
+
+#if IN_DEVELOPMENT
+
+    PlatformCaptureFrame(&frame_capture, back);
+
+#endif
+
+    PlatformPublishFrame(pipeline);
+
+    pipeline->sim_ns += SDL_GetTicksNS() - start_ns;
+    pipeline->frames_simulated++;
+    sem_post(&pipeline->sim_done);
+  }
+
+  PlatformClosePerfCounters(&pipeline->sim_counters);
+  return NULL;
+}
+
+internal_fn bool PlatformInitFramePipeline(frame_pipeline_t *pipeline) {
+  for (int buffer_i = 0; buffer_i < 3; buffer_i++) {
+    offscreen_buffer *buffer = &pipeline->buffers[buffer_i];
+    buffer->width = WIDTH;
+    buffer->height = HEIGHT;
+    buffer->length = WIDTH * HEIGHT * BYTES_PER_PX;
+    buffer->bytes_per_px = BYTES_PER_PX;
+  }
+  pipeline->back_idx = 0;
+  pipeline->front_idx = 1;
+  pipeline->ready = 2;
+
+  if (sem_init(&pipeline->sim_start, 0, 0) == -1 ||
+      sem_init(&pipeline->sim_done, 0, 0) == -1) {
+    return false;
+  }
+  return pthread_create(&pipeline->sim_thread, NULL, PlatformSimulationThread,
+                        pipeline) == 0;
+}
+
+internal_fn void PlatformBeginSimulation(frame_pipeline_t *pipeline,
+                                         thread_context_t *thread_context,
+                                         game_memory_t *memory,
+                                         game_input_t *input,
+                                         float delta_time) {
+  pipeline->thread_context = thread_context;
+  pipeline->memory = memory;
+  pipeline->input = input;
+  pipeline->delta_time = delta_time;
+  pipeline->sim_in_flight = true;
+  sem_post(&pipeline->sim_start);
+}
+
+// Returns true when a frame was in flight and has now finished
+internal_fn bool PlatformWaitForSimulation(frame_pipeline_t *pipeline) {
+  if (!pipeline->sim_in_flight) {
+    return false;
+  }
+  Uint64 start_ns = SDL_GetTicksNS();
+  while (sem_wait(&pipeline->sim_done) == -1) {
+    // Interrupted by a signal
+  }
+  pipeline->wait_ns += SDL_GetTicksNS() - start_ns;
+  pipeline->sim_in_flight = false;
+  return true;
+}
+
+internal_fn void PlatformShutdownFramePipeline(frame_pipeline_t *pipeline) {
+  PlatformWaitForSimulation(pipeline);
+  pipeline->sim_quit = true;
+  sem_post(&pipeline->sim_start);
+  pthread_join(pipeline->sim_thread, NULL);
+}
+
+// Overlap is the share of simulation time the main thread didn't spend
+// waiting for, i.e. time hidden behind the present and frame pacing
+internal_fn void PlatformLogFramePipelineStats(frame_pipeline_t *pipeline,
+                                               Uint64 current_tick) {
+  if (current_tick < pipeline->next_log_tick) {
+    return;
+  }
+  if (pipeline->next_log_tick != 0 && pipeline->frames_simulated > 0) {
+    Uint64 hidden_ns = pipeline->sim_ns > pipeline->wait_ns
+                           ? pipeline->sim_ns - pipeline->wait_ns
+                           : 0;
+    PlatformLog("Frames: %u simulated, %u presented, %u dropped, "
+                "%u duplicated, sim %.2fms avg, %.0f%% overlapped",
+                pipeline->frames_simulated, pipeline->frames_presented,
+                pipeline->frames_dropped, pipeline->frames_duplicated,
+                pipeline->sim_ns / 1000000.0f / pipeline->frames_simulated,
+                pipeline->sim_ns ? 100.0f * hidden_ns / pipeline->sim_ns
+                                 : 0.0f);
+  }
+  pipeline->next_log_tick = current_tick + frame_pipeline_log_interval;
+  pipeline->sim_ns = 0;
+  pipeline->wait_ns = 0;
+  pipeline->frames_simulated = 0;
+  pipeline->frames_presented = 0;
+  pipeline->frames_dropped = 0;
+  pipeline->frames_duplicated = 0;
+}
+
+// end Frame pipeline
+
+// Frame rate
+
+// The target follows the refresh rate of the display the window is on and is
+// re-detected when the window moves or the mode changes. Presents are paced
+// with vsync where the renderer supports the interval, otherwise by sleeping.
+// When too many frames in a window miss, the target drops to the next integer
+// divisor of the refresh rate, e.g. 60 -> 30 or 120 -> 60 -> 40, and it steps
+// back up after a run of clean windows. Each step up doubles the run needed
+// for the next one, so a scene that can't hold the faster rate doesn't flip
+// back and forth.
+
+const float frame_rate_fallback_hz = 60.0f;
+const int frame_rate_max_divisor = 4;
+const int frame_rate_window_frames = 120;
+const int frame_rate_missed_limit = 12;
+const int frame_rate_recover_windows = 4;
+const int frame_rate_max_recover_windows = 64;
+
+typedef struct frame_rate {
+  SDL_DisplayID display;
+  float display_hz;
+  int divisor;
+  bool vsync;
+  Uint64 target_frame_time_ns;
+
+  int window_frames;
+  int window_missed;
+  int clean_windows;
+  int recover_windows;
+} frame_rate_t;
+
+global_variable frame_rate_t frame_rate;
+
+internal_fn void PlatformApplyFrameRate(frame_rate_t *rate,
+                                        SDL_Renderer *renderer) {
+  float target_hz = rate->display_hz / rate->divisor;
+  rate->target_frame_time_ns = (Uint64)(1000000000.0 / target_hz);
+  target_fps = (int)(target_hz + 0.5f);
+
+  // Not every backend can skip vblanks, fall back to timing it ourselves
+  rate->vsync = SDL_SetRenderVSync(renderer, rate->divisor);
+  if (!rate->vsync) {
+    SDL_SetRenderVSync(renderer, SDL_RENDERER_VSYNC_DISABLED);
+  }
+
+  rate->window_frames = 0;
+  rate->window_missed = 0;
+  rate->clean_windows = 0;
+
+  PlatformLog("Frame rate: %.2fHz display, targeting %.2fHz with %s",
+              rate->display_hz, target_hz, rate->vsync ? "vsync" : "sleep");
+}
+
+internal_fn void PlatformDetectRefreshRate(frame_rate_t *rate,
+                                           SDL_Window *window,
+                                           SDL_Renderer *renderer) {
+  SDL_DisplayID display = SDL_GetDisplayForWindow(window);
+  const SDL_DisplayMode *mode =
+      display ? SDL_GetCurrentDisplayMode(display) : NULL;
+  float display_hz = (mode && mode->refresh_rate > 0.0f)
+                         ? mode->refresh_rate
+                         : frame_rate_fallback_hz;
+
+  if (display == rate->display && display_hz == rate->display_hz) {
+    return;
+  }
+  rate->display = display;
+  rate->display_hz = display_hz;
+  rate->divisor = 1;
+  rate->recover_windows = frame_rate_recover_windows;
+  PlatformApplyFrameRate(rate, renderer);
+}
+
+// frame_period_ns is the time between the starts of two frames, so with vsync
+// it includes waiting for the vblank and a missed vblank shows up as a long
+// period. A quarter frame of slack covers scheduler jitter
+internal_fn void PlatformTrackFrameRate(frame_rate_t *rate,
+                                        SDL_Renderer *renderer,
+                                        Uint64 frame_period_ns) {
+  rate->window_frames++;
+  if (frame_period_ns >
+      rate->target_frame_time_ns + rate->target_frame_time_ns / 4) {
+    rate->window_missed++;
+  }
+  if (rate->window_frames < frame_rate_window_frames) {
+    return;
+  }
+
+  int missed = rate->window_missed;
+  rate->window_frames = 0;
+  rate->window_missed = 0;
+
+  if (missed > frame_rate_missed_limit &&
+      rate->divisor < frame_rate_max_divisor) {
+    PlatformLog("Missed %d of %d frames, dropping the frame rate", missed,
+                frame_rate_window_frames);
+    rate->divisor++;
+    PlatformApplyFrameRate(rate, renderer);
+  } else if (missed > 0) {
+    PlatformLog("Missed %d of %d frames", missed, frame_rate_window_frames);
+    rate->clean_windows = 0;
+  } else if (rate->divisor > 1 &&
+             ++rate->clean_windows >= rate->recover_windows) {
+    rate->divisor--;
+    rate->recover_windows =
+        SDL_min(rate->recover_windows * 2, frame_rate_max_recover_windows);
+    PlatformApplyFrameRate(rate, renderer);
   }
 }
 
+// end Frame rate
+
 void PlatformUpdateAndDrawFrame(SDL_Window *window, SDL_Renderer *renderer,
                                 SDL_FRect *destR, SDL_Texture *tex,
                                 offscreen_buffer *buffer) {
-  destR->w = pixel_buffer.width * scale;
-  destR->h = pixel_buffer.height * scale;
+  destR->w = buffer->width * scale;
+  destR->h = buffer->height * scale;
   int window_width;
   int window_height;
   int gutter_x = 0;
@@ -574,8 +2662,8 @@ void PlatformUpdateAndDrawFrame(SDL_Window *window, SDL_Renderer *renderer,
   destR->x = gutter_x;
   destR->y = gutter_y;
 
-  SDL_UpdateTexture(tex, NULL, &pixel_buffer.buffer,
-                    pixel_buffer.width * pixel_buffer.bytes_per_px);
+  SDL_UpdateTexture(tex, NULL, &buffer->buffer,
+                    buffer->width * buffer->bytes_per_px);
 
   SDL_SetRenderDrawColor(renderer, 0x18, 0x18, 0x18, 0xFF);
   SDL_RenderClear(renderer);
@@ -595,13 +2683,13 @@ int main(int argc, char *argv[]) {
 #endif
 
   target_fps = 60;
-  target_frame_time = 1000 / target_fps;
   target_physics_updates_ps = 30;
   target_physics_time = 1000 / target_physics_updates_ps;
 
   game_memory_t game_memory = {};
   game_memory.permanent_storage_size = Megabytes(64);
   game_memory.transient_storage_size = Megabytes(512);
+  game_memory.transient_storage_used = GAME_STORAGE_USED_UNKNOWN;
 
 #if IN_DEVELOPMENT
 
@@ -625,6 +2713,14 @@ int main(int argc, char *argv[]) {
 
       .recording = false,
       .playing = false,
+
+      .snapshot_writer = {},
+      .snapshot_writer_running = false,
+
+      .playback_frame_idx = 0,
+      .playback_expected_hash = 0,
+      .playback_has_hash = false,
+      .playback_diverged = false,
   };
 
   platform_state.game_memory_total_size =
@@ -643,6 +2739,22 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  PlatformInitLogging();
+  PlatformInitCRC32C();
+  PlatformInitPagemap();
+  PlatformInitMemoryStats(&game_memory);
+
+  PlatformInitWorkQueue();
+  game_memory.work_queue = &work_queue;
+  game_memory.PlatformAddEntry = PlatformAddEntry;
+  game_memory.PlatformCompleteAllWork = PlatformCompleteAllWork;
+
+#if IN_DEVELOPMENT
+
+  PlatformInitStateHashing(&game_memory);
+
+#endif
+
   local_persist SDL_Window *window = NULL;
   local_persist SDL_Renderer *renderer = NULL;
   local_persist SDL_Texture *tex = NULL;
@@ -652,6 +2764,7 @@ int main(int argc, char *argv[]) {
   };
 
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD);
+  PlatformLoadInputBindings();
   SDL_CreateWindowAndRenderer("Hello SDL3", WIDTH * scale, HEIGHT * scale, 0,
                               &window, &renderer);
   SDL_SetWindowResizable(window, true);
@@ -660,35 +2773,65 @@ int main(int argc, char *argv[]) {
 
   thread_context_t thread_context = {};
 
-  // Query OS for info about monitors such as refresh rate
-
-  // float highestRate = 0.0f;
-  // int nDisplays;
-  // SDL_DisplayID *displays = SDL_GetDisplays(&nDisplays);
-  // for (int di = 0; di < nDisplays; di++) {
-  //   int nModes;
-  //   SDL_DisplayMode **displayModes =
-  //       SDL_GetFullscreenDisplayModes(displays[di], &nModes);
-  //   for (int mi = 0; mi < nModes; mi++) {
-  //     float rate = (*displayModes)[mi].refresh_rate;
-  //     if (rate > highestRate)
-  //       highestRate = rate;
-  //   }
-  //   SDL_free(displayModes);
-  // }
-  // SDL_Log("Highest available rate: %f", highestRate);
-  // SDL_free(displays);
-
-  local_persist Uint64 last_tick;
+  if (!PlatformInitFramePipeline(&frame_pipeline)) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Unable to start simulation thread");
+    return 1;
+  }
+
+  PlatformOpenPerfCounters(&draw_counters, "main");
+
+  // Query OS for the refresh rate of the display the window is on
+
+  PlatformDetectRefreshRate(&frame_rate, window, renderer);
+
   local_persist Uint64 current_tick;
+  local_persist Uint64 last_frame_start_ns;
+  local_persist Uint64 frame_start_ns;
   local_persist float delta_time;
 
+  local_persist game_perf_sample_t draw_sample;
+
   local_persist game_input_t input[2] = {};
   local_persist game_input_t *new_input = &input[0];
   local_persist game_input_t *old_input = &input[1];
 
   while (!quit) {
 
+    // Finish the frame that was simulated during the last present, after this
+    // the simulation thread is idle until PlatformBeginSimulation
+
+    if (PlatformWaitForSimulation(&frame_pipeline)) {
+
+      // The present that ran alongside the finished update goes with it
+      PlatformRecordPerfFrame(&game_memory.perf, &frame_pipeline.update_sample,
+                              &draw_sample);
+
+#if IN_DEVELOPMENT
+
+      // The input that drove the finished frame is old_input by now, and its
+      // frame time is still in the pipeline. Recording happens here so the
+      // state hash can go with them
+
+      if (platform_state.recording || platform_state.playing) {
+        bool has_state_hash = state_hashing_enabled;
+        Uint32 state_hash =
+            has_state_hash ? PlatformHashGameState(&game_memory) : 0;
+
+        if (platform_state.recording) {
+          PlatformRecordInput(&platform_state, old_input,
+                              frame_pipeline.delta_time, has_state_hash,
+                              state_hash);
+        }
+
+        if (platform_state.playing) {
+          PlatformCheckPlaybackHash(&platform_state, has_state_hash,
+                                    state_hash);
+        }
+      }
+
+#endif
+    }
+
 #if STATIC_WHOLE_COMPILE
 #else
 
@@ -696,14 +2839,26 @@ int main(int argc, char *argv[]) {
 
     if (game_update_and_render_ptr == NULL) {
       SDL_Log("game_update_and_render_ptr is NULL");
+      PlatformShutdownLogging();
       exit(1);
     }
 
 #endif
 
-    last_tick = current_tick;
     current_tick = SDL_GetTicks();
-    delta_time = (current_tick - last_tick) / 1000.0f;
+    last_frame_start_ns = frame_start_ns;
+    frame_start_ns = SDL_GetTicksNS();
+    delta_time = (frame_start_ns - last_frame_start_ns) / 1000000000.0f;
+
+    if (last_frame_start_ns) {
+      PlatformTrackFrameRate(&frame_rate, renderer,
+                             frame_start_ns - last_frame_start_ns);
+    }
+
+    PlatformReloadInputBindings();
+    PlatformUpdateMemoryStats(&game_memory, current_tick);
+    PlatformLogFramePipelineStats(&frame_pipeline, current_tick);
+    PlatformLogPerfCounters(&game_memory.perf, current_tick);
 
     *new_input = {};
     for (int button_i = 0;
@@ -712,6 +2867,11 @@ int main(int argc, char *argv[]) {
           old_input->controller.buttons[button_i].ended_down;
     }
     new_input->controller.is_analog = old_input->controller.is_analog;
+    // Axis events only come when the stick moves
+    new_input->controller.left_stick_average_x =
+        old_input->controller.left_stick_average_x;
+    new_input->controller.left_stick_average_y =
+        old_input->controller.left_stick_average_y;
     new_input->mouseX = old_input->mouseX;
     new_input->mouseY = old_input->mouseY;
     new_input->mouseZ = old_input->mouseZ;
@@ -727,30 +2887,35 @@ int main(int argc, char *argv[]) {
       //   SDL_Log("Window Resized");
       // }
 
+      if (event.type == SDL_EVENT_WINDOW_DISPLAY_CHANGED ||
+          event.type == SDL_EVENT_DISPLAY_CURRENT_MODE_CHANGED) {
+        PlatformDetectRefreshRate(&frame_rate, window, renderer);
+      }
+
       if (event.type == SDL_EVENT_GAMEPAD_REMOVED) {
-        SDL_Log("Gamepad Removed");
+        PlatformLog("Gamepad Removed");
       }
 
       if (event.type == SDL_EVENT_GAMEPAD_ADDED) {
-        SDL_Log("Gamepad Added");
+        PlatformLog("Gamepad Added");
         joystickId = SDL_GetGamepads(&nGamepads);
         gamepad = SDL_OpenGamepad(*joystickId);
-        SDL_Log("Gamepad Added %i", nGamepads);
+        PlatformLog("Gamepad Added %i", nGamepads);
       }
 
-      PlatformHandleInputEvent(&event, new_input, old_input, &platform_state);
+      Uint32 hotkeys = PlatformHandleInputEvent(&event, new_input, old_input);
+      if (hotkeys) {
+        PlatformHandleHotkeys(hotkeys, new_input, &platform_state);
+      }
     }
 
 #if IN_DEVELOPMENT
 
     // // Input recording and playback
 
-    if (platform_state.recording) {
-      PlatformRecordInput(&platform_state, new_input);
-    }
-
+    // Replaces the measured delta_time with the recorded one
     if (platform_state.playing) {
-      PlatformPlaybackInput(&platform_state, new_input);
+      PlatformPlaybackInput(&platform_state, new_input, &delta_time);
     }
 
     // // end Input recording and playback
@@ -759,44 +2924,49 @@ int main(int argc, char *argv[]) {
 // Disable input recording and playback for non-DEV builds
 #endif
 
-    // Draw
-
-    PlatformUpdateAndDrawFrame(window, renderer, &destR, tex, &pixel_buffer);
-
-    // end Draw
-
-    // Update
+    // Update, runs on the simulation thread while this one presents
 
-#if STATIC_WHOLE_COMPILE
+    PlatformBeginSimulation(&frame_pipeline, &thread_context, &game_memory,
+                            new_input, delta_time);
 
-    game_update_and_render(&thread_context, &game_memory, &pixel_buffer,
-                           new_input, delta_time);
+    // end Update
 
-#else
+    // Draw
 
-    (*game_update_and_render_ptr)(&thread_context, &game_memory, &pixel_buffer,
-                                  new_input, delta_time);
+    PlatformBeginPerfCounters(&draw_counters);
+    PlatformUpdateAndDrawFrame(window, renderer, &destR, tex,
+                               PlatformAcquireFrame(&frame_pipeline));
+    PlatformEndPerfCounters(&draw_counters, &draw_sample);
 
-#endif
+    // end Draw
 
     game_input_t *temp_input_ptr = new_input;
     new_input = old_input;
     old_input = temp_input_ptr;
 
-    // end Update
-
-    Uint64 frame_time = SDL_GetTicks() - current_tick;
+    // With vsync the present has already waited for the vblank, misses are
+    // counted by PlatformTrackFrameRate at the start of the next frame
 
-    if (frame_time > 12)
-      SDL_Log("WARN: target: %ld, time: %ld", target_frame_time, frame_time);
-
-    if (frame_time < target_frame_time) {
-      SDL_Delay(target_frame_time - frame_time);
-    } else {
-      SDL_Log("Failed to hit framerate");
+    if (!frame_rate.vsync) {
+      Uint64 frame_time_ns = SDL_GetTicksNS() - frame_start_ns;
+      if (frame_time_ns < frame_rate.target_frame_time_ns) {
+        SDL_DelayNS(frame_rate.target_frame_time_ns - frame_time_ns);
+      }
     }
   }
 
+  PlatformShutdownFramePipeline(&frame_pipeline);
+  PlatformClosePerfCounters(&draw_counters);
+
+#if IN_DEVELOPMENT
+
+  PlatformStopCapture(&frame_capture);
+  PlatformWaitForSnapshotWrite(&platform_state);
+
+#endif
+
+  PlatformShutdownLogging();
+
   SDL_Quit();
   return 0;
 }
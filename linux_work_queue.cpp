@@ -0,0 +1,195 @@
+// Work queue, included by linux_platform.cpp. bench/work_queue_bench.cpp
+// includes it too, with stand-ins for the SDL types and PlatformLog.
+
+// A pool of worker threads, one pinned to each core the process may run on
+// except the first, which is left to the main and simulation threads. Entries
+// go in a bounded lock-free multi-producer multi-consumer ring, each slot has
+// a sequence number that says whether it's ready to be written or read, so
+// producers and consumers only ever contend on a compare-and-swap of their
+// own cursor. Every worker pulls from the same ring, which balances the load
+// the way stealing would without per-thread deques. Idle workers sleep on a
+// semaphore. Set WORKER_THREADS to override the worker count, 0 runs
+// everything on the calling thread.
+
+#define WORK_QUEUE_SIZE 256
+#define WORK_QUEUE_MAX_WORKERS 63
+
+typedef struct platform_work_queue_entry {
+  Uint64 sequence;
+  platform_work_queue_callback *callback;
+  void *data;
+} platform_work_queue_entry_t;
+
+struct platform_work_queue {
+  // Kept on separate cache lines so producers and consumers don't false share
+  alignas(64) Uint64 enqueue_pos;
+  alignas(64) Uint64 dequeue_pos;
+  alignas(64) Uint32 entries_added;
+  Uint32 entries_completed;
+
+  sem_t semaphore;
+
+  int worker_count;
+  pthread_t workers[WORK_QUEUE_MAX_WORKERS];
+  thread_context_t worker_contexts[WORK_QUEUE_MAX_WORKERS];
+
+  // Used when the thread calling PlatformCompleteAllWork helps out
+  thread_context_t helper_context;
+
+  platform_work_queue_entry_t entries[WORK_QUEUE_SIZE];
+};
+
+global_variable platform_work_queue work_queue;
+
+internal_fn inline void PlatformSpinPause() {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#else
+  sched_yield();
+#endif
+}
+
+internal_fn bool PlatformDoNextWorkEntry(platform_work_queue *queue,
+                                         thread_context_t *thread) {
+  Uint64 pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    platform_work_queue_entry_t *entry =
+        &queue->entries[pos & (WORK_QUEUE_SIZE - 1)];
+    Uint64 sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    Sint64 diff = (Sint64)sequence - (Sint64)(pos + 1);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        platform_work_queue_callback *callback = entry->callback;
+        void *data = entry->data;
+        // Hand the slot back to producers for the next lap
+        __atomic_store_n(&entry->sequence, pos + WORK_QUEUE_SIZE,
+                         __ATOMIC_RELEASE);
+
+        callback(thread, data);
+        __atomic_fetch_add(&queue->entries_completed, 1, __ATOMIC_RELEASE);
+        return true;
+      }
+      // pos was reloaded by the failed compare exchange
+    } else if (diff < 0) {
+      // Empty
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+internal_fn void PlatformAddEntry(platform_work_queue *queue,
+                                  platform_work_queue_callback *callback,
+                                  void *data) {
+  __atomic_fetch_add(&queue->entries_added, 1, __ATOMIC_RELAXED);
+
+  if (queue->worker_count == 0) {
+    callback(&queue->helper_context, data);
+    __atomic_fetch_add(&queue->entries_completed, 1, __ATOMIC_RELEASE);
+    return;
+  }
+
+  Uint64 pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    platform_work_queue_entry_t *entry =
+        &queue->entries[pos & (WORK_QUEUE_SIZE - 1)];
+    Uint64 sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    Sint64 diff = (Sint64)sequence - (Sint64)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        entry->callback = callback;
+        entry->data = data;
+        __atomic_store_n(&entry->sequence, pos + 1, __ATOMIC_RELEASE);
+        sem_post(&queue->semaphore);
+        return;
+      }
+    } else if (diff < 0) {
+      // Full, run it here rather than block
+      callback(&queue->helper_context, data);
+      __atomic_fetch_add(&queue->entries_completed, 1, __ATOMIC_RELEASE);
+      return;
+    } else {
+      pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+internal_fn void PlatformCompleteAllWork(platform_work_queue *queue) {
+  while (__atomic_load_n(&queue->entries_completed, __ATOMIC_ACQUIRE) !=
+         __atomic_load_n(&queue->entries_added, __ATOMIC_RELAXED)) {
+    if (!PlatformDoNextWorkEntry(queue, &queue->helper_context)) {
+      // The rest are in flight on the workers
+      PlatformSpinPause();
+    }
+  }
+}
+
+internal_fn void *PlatformWorkQueueThread(void *arg) {
+  thread_context_t *thread = (thread_context_t *)arg;
+  platform_work_queue *queue = &work_queue;
+
+  for (;;) {
+    if (!PlatformDoNextWorkEntry(queue, thread)) {
+      sem_wait(&queue->semaphore);
+    }
+  }
+  return NULL;
+}
+
+internal_fn void PlatformInitWorkQueue() {
+  platform_work_queue *queue = &work_queue;
+
+  for (int entry_i = 0; entry_i < WORK_QUEUE_SIZE; entry_i++) {
+    queue->entries[entry_i].sequence = entry_i;
+  }
+  queue->helper_context.logical_thread_index = 0;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  int cpus[CPU_SETSIZE];
+  int cpu_count = 0;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus[cpu_count++] = cpu;
+      }
+    }
+  }
+
+  int worker_count = cpu_count > 1 ? cpu_count - 1 : 0;
+  char *worker_override = getenv("WORKER_THREADS");
+  if (worker_override) {
+    worker_count = atoi(worker_override);
+  }
+  worker_count = SDL_clamp(worker_count, 0, WORK_QUEUE_MAX_WORKERS);
+
+  if (sem_init(&queue->semaphore, 0, 0) == -1) {
+    worker_count = 0;
+  }
+
+  queue->worker_count = worker_count;
+  for (int worker_i = 0; worker_i < worker_count; worker_i++) {
+    thread_context_t *thread = &queue->worker_contexts[worker_i];
+    thread->logical_thread_index = worker_i + 1;
+    if (pthread_create(&queue->workers[worker_i], NULL,
+                       PlatformWorkQueueThread, thread) != 0) {
+      PlatformLog("Unable to start worker thread %d", worker_i + 1);
+      queue->worker_count = worker_i;
+      break;
+    }
+    if (cpu_count > 1) {
+      cpu_set_t pinned;
+      CPU_ZERO(&pinned);
+      CPU_SET(cpus[(worker_i + 1) % cpu_count], &pinned);
+      pthread_setaffinity_np(queue->workers[worker_i], sizeof(pinned),
+                             &pinned);
+    }
+  }
+
+  PlatformLog("Work queue started with %d worker threads", queue->worker_count);
+}